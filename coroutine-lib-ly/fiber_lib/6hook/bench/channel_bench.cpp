@@ -0,0 +1,95 @@
+#include "ioscheduler_ly.h"
+#include "channel_ly.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+using namespace sylar;
+
+// Channel吞吐: P个生产者协程, C个消费者协程, 共发送200万条消息
+// 对比每条消息scheduleLock一个std::function的做法
+
+typedef std::chrono::steady_clock Clock;
+
+static const long N = 2000000;
+
+static void channelBench(int producers, int consumers, size_t capacity, int threads)
+{
+	Channel<long> ch(capacity);
+	std::atomic<long> sum{0};
+	std::atomic<long> got{0};
+	std::atomic<int> running{producers};
+	long per = N / producers;
+	Clock::time_point start = Clock::now();
+	{
+		IOManager iom(threads);
+		for(int c = 0; c < consumers; c++)
+		{
+			iom.scheduleLock([&](){
+				long v = 0;
+				long s = 0;
+				long n = 0;
+				while(ch.recv(v))
+				{
+					s += v;
+					n++;
+				}
+				sum += s;
+				got += n;
+			});
+		}
+		for(int p = 0; p < producers; p++)
+		{
+			iom.scheduleLock([&, p](){
+				for(long i = 0; i < per; i++)
+				{
+					ch.send(p * per + i + 1);
+				}
+				// 最后一个生产者关闭通道
+				if(--running == 0)
+				{
+					ch.close();
+				}
+			});
+		}
+	}
+	double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	long n = per * producers;
+	std::cout << "channel " << producers << ":" << consumers << " cap " << capacity << " threads " << threads
+		<< ": " << got / us << " M msgs/s" << (got == n && sum == n * (n + 1) / 2 ? "" : " WRONG") << std::endl;
+}
+
+static void scheduleBench(int producers, int threads)
+{
+	std::atomic<long> got{0};
+	long per = N / producers;
+	Clock::time_point start = Clock::now();
+	{
+		IOManager iom(threads);
+		for(int p = 0; p < producers; p++)
+		{
+			iom.scheduleLock([&, per](){
+				for(long i = 0; i < per; i++)
+				{
+					IOManager::GetThis()->scheduleLock([&got](){ got++; });
+				}
+			});
+		}
+	}
+	double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	std::cout << "scheduleLock per msg, " << producers << " producers, threads " << threads << ": " << got / us << " M msgs/s" << std::endl;
+}
+
+int main()
+{
+	channelBench(1, 1, 1024, 1);
+	channelBench(1, 1, 1024, 2);
+	channelBench(8, 1, 1024, 8);
+	channelBench(8, 8, 1024, 8);
+	channelBench(64, 64, 1024, 8);
+	channelBench(8, 8, 16, 8);
+	scheduleBench(1, 2);
+	scheduleBench(8, 8);
+	return 0;
+}
@@ -0,0 +1,87 @@
+#include "hook_ly.h"
+#include "fd_manager_ly.h"
+
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace sylar;
+
+// hook路径上FdMgr的开销: 多线程查表, 以及返回EAGAIN的hook recv比裸recv多出的时间
+// fd设置了用户层非阻塞, hook的recv直接返回, 不会挂起
+// 参数: 线程数, 默认32
+// 只用到原有的接口, 在改动前的树上也能编译, 用来对比
+
+static const long N = 200000;
+
+typedef std::chrono::steady_clock Clock;
+
+template <class F>
+static double run(int threads, F f)
+{
+	Clock::time_point start = Clock::now();
+	std::vector<std::thread> workers;
+	for(int t = 0; t < threads; t++)
+	{
+		workers.emplace_back(f, t);
+	}
+	for(auto& w : workers)
+	{
+		w.join();
+	}
+	return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (N * threads);
+}
+
+int main(int argc, char** argv)
+{
+	int threads = argc > 1 ? atoi(argv[1]) : 32;
+
+	std::vector<int> fds;
+	for(int i = 0; i < threads; i++)
+	{
+		int sv[2];
+		socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+		FdMgr::GetInstance()->get(sv[0], true);
+		// 经过hook的fcntl -> 记为用户层非阻塞
+		fcntl(sv[0], F_SETFL, O_NONBLOCK);
+		fds.push_back(sv[0]);
+	}
+
+	double lookup = run(threads, [&fds](int t){
+		long found = 0;
+		for(long i = 0; i < N; i++)
+		{
+			found += FdMgr::GetInstance()->get(fds[t]) ? 1 : 0;
+		}
+		if(found != N)
+		{
+			std::cerr << "lookup failed" << std::endl;
+		}
+	});
+
+	double hooked = run(threads, [&fds](int t){
+		char c;
+		for(long i = 0; i < N; i++)
+		{
+			recv(fds[t], &c, 1, 0);
+		}
+	});
+
+	double raw = run(threads, [&fds](int t){
+		char c;
+		for(long i = 0; i < N; i++)
+		{
+			recv_f(fds[t], &c, 1, MSG_DONTWAIT);
+		}
+	});
+
+	std::cout << "threads " << threads << ": lookup " << lookup << " ns, hooked recv " << hooked
+		<< " ns, raw recv " << raw << " ns, hook overhead " << hooked - raw << " ns" << std::endl;
+	return 0;
+}
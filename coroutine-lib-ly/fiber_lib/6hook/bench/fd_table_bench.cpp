@@ -0,0 +1,62 @@
+#include "ioscheduler_ly.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace sylar;
+
+// fd上下文表的争用: 多个线程在各自的socket上反复addEvent/delEvent
+// EPOLL_PERSISTENT下fd只在第一次登记时epoll_ctl, 之后不进内核, 测到的只是查表和加锁
+// 参数: 线程数, 默认32
+
+static const long N = 100000;
+
+int main(int argc, char** argv)
+{
+	int threads = argc > 1 ? atoi(argv[1]) : 32;
+	IOManager iom(1, true, "IOManager", false, IOManager::EPOLL_PERSISTENT);
+
+	std::vector<int> fds;
+	for(int i = 0; i < threads; i++)
+	{
+		fds.push_back(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0));
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for(int t = 0; t < threads; t++)
+	{
+		workers.emplace_back([&iom, fd = fds[t]](){
+			for(long i = 0; i < N; i++)
+			{
+				if(iom.addEvent(fd, IOManager::READ, [](){}) != 0)
+				{
+					std::cerr << "addEvent failed" << std::endl;
+					return;
+				}
+				iom.delEvent(fd, IOManager::READ);
+			}
+		});
+	}
+	for(auto& w : workers)
+	{
+		w.join();
+	}
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "threads " << threads << ": " << ns / N << " ns per add+del pair on each thread, "
+		<< ns / 1e6 << " ms total" << std::endl;
+
+	for(int fd : fds)
+	{
+		iom.cancelAll(fd);
+		close(fd);
+	}
+	return 0;
+}
@@ -0,0 +1,77 @@
+#include "ioscheduler_ly.h"
+#include "fiber_sync_ly.h"
+#include "hook_ly.h"
+
+#include <chrono>
+#include <iostream>
+#include <mutex>
+
+using namespace sylar;
+
+// 协程同步原语: 8个线程上1万个协程各对共享计数器加锁/解锁100次, std::mutex和FiberMutex各一遍
+// 以及1万个协程用FiberSemaphore限制并发为100, 每个协程持有名额期间hook的usleep 1ms
+// 线程级的Semaphore在8个worker都阻塞后会死锁, 不测
+
+typedef std::chrono::steady_clock Clock;
+
+static const int FIBERS = 10000;
+static const int ITERS = 100;
+
+template <class Mutex>
+static double lockBench()
+{
+	Mutex mutex;
+	long counter = 0;
+	Clock::time_point start = Clock::now();
+	{
+		IOManager iom(8);
+		for(int f = 0; f < FIBERS; f++)
+		{
+			iom.scheduleLock([&](){
+				for(int i = 0; i < ITERS; i++)
+				{
+					mutex.lock();
+					counter++;
+					mutex.unlock();
+					// 时常让出, 让协程在线程间交错
+					if(i % 8 == 7)
+					{
+						IOManager::GetThis()->scheduleLock(Fiber::GetThis());
+						Fiber::GetThis()->yield();
+					}
+				}
+			});
+		}
+	}
+	if(counter != (long)FIBERS * ITERS)
+	{
+		std::cerr << "counter " << counter << std::endl;
+	}
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static double semaphoreBench()
+{
+	FiberSemaphore sem(100);
+	Clock::time_point start = Clock::now();
+	{
+		IOManager iom(8);
+		for(int f = 0; f < FIBERS; f++)
+		{
+			iom.scheduleLock([&sem](){
+				sem.wait();
+				usleep(1000);
+				sem.signal();
+			});
+		}
+	}
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main()
+{
+	std::cout << "std::mutex: " << lockBench<std::mutex>() << " ms" << std::endl;
+	std::cout << "FiberMutex: " << lockBench<FiberMutex>() << " ms" << std::endl;
+	std::cout << "FiberSemaphore, limit 100, 1ms usleep: " << semaphoreBench() << " ms" << std::endl;
+	return 0;
+}
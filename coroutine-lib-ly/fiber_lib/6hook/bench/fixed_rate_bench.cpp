@@ -0,0 +1,78 @@
+#include "ioscheduler_ly.h"
+#include "hook_ly.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+using namespace sylar;
+
+// 繁忙调度器上的timer漂移: 2个worker, 4个协程不断做0-800us的计算再hook usleep 100us
+// 固定延迟(addTimer recurring), 固定频率SKIP, 固定频率CATCH_UP 各跑10000个周期
+// 参数: 周期(微秒), 默认1000
+
+typedef std::chrono::steady_clock Clock;
+
+static const long PERIODS = 10000;
+
+static void run(int mode, std::chrono::microseconds period)
+{
+	std::atomic<long> fired{0};
+	std::atomic<bool> stop{false};
+	Clock::time_point start;
+	Clock::time_point end;
+	{
+		IOManager iom(2);
+		for(int i = 0; i < 4; i++)
+		{
+			iom.scheduleLock([&stop](){
+				while(!stop)
+				{
+					Clock::time_point begin = Clock::now();
+					std::chrono::microseconds burst(rand() % 800);
+					while(Clock::now() - begin < burst);
+					usleep(100);
+				}
+			});
+		}
+		std::shared_ptr<Timer> timer;
+		start = Clock::now();
+		auto cb = [&](){
+			if(++fired == PERIODS)
+			{
+				end = Clock::now();
+				timer->cancel();
+				stop = true;
+			}
+		};
+		if(mode == 0)
+		{
+			timer = iom.addTimer(period, cb, true);
+		}
+		else
+		{
+			timer = iom.addFixedRateTimer(period, cb, mode == 1 ? TimerManager::SKIP : TimerManager::CATCH_UP);
+		}
+	}
+	static const char* names[] = {"fixed-delay", "fixed-rate SKIP", "fixed-rate CATCH_UP"};
+	// 原网格上经过的周期数, 以及最后一次触发偏离其网格点多少
+	long grid = (end - start) / period;
+	double drift = std::chrono::duration<double, std::milli>(end - (start + PERIODS * period)).count();
+	double phase = std::chrono::duration<double, std::milli>((end - start) - grid * period).count();
+	std::cout << names[mode] << ": end vs start + N * period " << drift << " ms, "
+		<< grid - PERIODS << " periods behind, last firing " << phase << " ms after its grid point" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	// 主线程不走hook
+	set_hook_enable(false);
+	std::chrono::microseconds period(argc > 1 ? atol(argv[1]) : 1000);
+	std::cout << PERIODS << " periods of " << period.count() << " us" << std::endl;
+	for(int mode = 0; mode < 3; mode++)
+	{
+		run(mode, period);
+	}
+	return 0;
+}
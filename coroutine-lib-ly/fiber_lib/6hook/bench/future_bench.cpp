@@ -0,0 +1,77 @@
+#include "ioscheduler_ly.h"
+#include "future_ly.h"
+#include "hook_ly.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace sylar;
+
+// 请求协程扇出100个hook后的10ms调用, 用WhenAll汇总
+// 1个请求和8个并发请求的耗时, 以及Spawn+join的开销
+// 参数: 线程数, 默认4
+
+static const int CALLS = 100;
+static const int REQUESTS = 8;
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 一个请求: 扇出CALLS个后端调用并等待全部完成
+static long request()
+{
+	std::vector<Future<long>> calls;
+	for(long i = 0; i < CALLS; i++)
+	{
+		calls.push_back(Spawn([i](){
+			usleep(10000);
+			return i;
+		}).future());
+	}
+	long sum = 0;
+	for(long v : WhenAll(std::move(calls)).get())
+	{
+		sum += v;
+	}
+	return sum;
+}
+
+int main(int argc, char** argv)
+{
+	int threads = argc > 1 ? atoi(argv[1]) : 4;
+	set_hook_enable(false);
+
+	IOManager iom(threads);
+	Spawn([](){
+		auto start = std::chrono::steady_clock::now();
+		long sum = request();
+		std::cout << "1 request, fan-out " << CALLS << " x 10ms: " << elapsedMs(start) << " ms (sum " << sum << ")" << std::endl;
+
+		start = std::chrono::steady_clock::now();
+		std::vector<JoinHandle<long>> reqs;
+		for(int i = 0; i < REQUESTS; i++)
+		{
+			reqs.push_back(Spawn(request));
+		}
+		sum = 0;
+		for(auto& r : reqs)
+		{
+			sum += r.join();
+		}
+		std::cout << REQUESTS << " concurrent requests: " << elapsedMs(start) << " ms (sum " << sum << ")" << std::endl;
+
+		const int N = 20000;
+		start = std::chrono::steady_clock::now();
+		sum = 0;
+		for(int i = 0; i < N; i++)
+		{
+			sum += Spawn([i](){ return i; }).join();
+		}
+		std::cout << "Spawn + join: " << elapsedMs(start) * 1000 / N << " us/task" << std::endl;
+	}, &iom).join();
+	return 0;
+}
@@ -0,0 +1,50 @@
+#include "ioscheduler_ly.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+using namespace sylar;
+
+// 短回调端到端的开销: scheduleLock(在协程里运行) 对比 scheduleInline(直接在调度协程上运行)
+// 参数: 线程数, 默认1
+
+static const long N = 200000;
+
+static std::atomic<long> s_done{0};
+
+int main(int argc, char** argv)
+{
+	int threads = argc > 1 ? atoi(argv[1]) : 1;
+	for(bool inline_cb : {false, true})
+	{
+		s_done = 0;
+		auto start = std::chrono::steady_clock::now();
+		{
+			IOManager iom(threads);
+			iom.scheduleLock([inline_cb](){
+				for(long i = 0; i < N; i++)
+				{
+					if(inline_cb)
+					{
+						IOManager::GetThis()->scheduleInline([](){ s_done++; });
+					}
+					else
+					{
+						IOManager::GetThis()->scheduleLock([](){ s_done++; });
+					}
+					// 分批投递, 让队列保持短
+					if(i % 64 == 63)
+					{
+						IOManager::GetThis()->scheduleLock(Fiber::GetThis());
+						Fiber::GetThis()->yield();
+					}
+				}
+			});
+		}
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		std::cout << (inline_cb ? "scheduleInline: " : "scheduleLock: ") << ns / N << " ns/task" << std::endl;
+	}
+	return 0;
+}
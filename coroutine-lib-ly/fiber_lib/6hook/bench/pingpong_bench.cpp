@@ -0,0 +1,63 @@
+#include "ioscheduler_ly.h"
+#include "hook_ly.h"
+#include "fd_manager_ly.h"
+
+#include <sys/socket.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace sylar;
+
+// socketpair乒乓的往返时间, 两端各一个协程, 每次recv都挂起等待
+// 参数: [线程数, 默认1] [模式: x -> 分片模式, u -> io_uring后端, p -> EPOLL_PERSISTENT]
+
+static const long N = 20000;
+
+int main(int argc, char** argv)
+{
+	int threads = argc > 1 ? atoi(argv[1]) : 1;
+	const char* mode = argc > 2 ? argv[2] : "";
+	bool sharded = strchr(mode, 'x') != nullptr;
+	IOManager::Backend backend = strchr(mode, 'u') ? IOManager::IO_URING : strchr(mode, 'p') ? IOManager::EPOLL_PERSISTENT : IOManager::EPOLL;
+
+	std::chrono::steady_clock::time_point start;
+	std::chrono::steady_clock::time_point end;
+	{
+		IOManager iom(threads, true, "IOManager", sharded, backend);
+		backend = iom.getBackend();
+		iom.scheduleLock([&](){
+			int sv[2];
+			socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+			// socketpair没有hook, 手动登记让recv/send走协程等待
+			FdMgr::GetInstance()->get(sv[0], true);
+			FdMgr::GetInstance()->get(sv[1], true);
+			int a = sv[0];
+			int b = sv[1];
+			IOManager::GetThis()->scheduleLock([b](){
+				char c;
+				for(long i = 0; i < N; i++)
+				{
+					recv(b, &c, 1, 0);
+					send(b, &c, 1, 0);
+				}
+			});
+			char c = 'x';
+			start = std::chrono::steady_clock::now();
+			for(long i = 0; i < N; i++)
+			{
+				send(a, &c, 1, 0);
+				recv(a, &c, 1, 0);
+			}
+			end = std::chrono::steady_clock::now();
+			close(a);
+			close(b);
+		});
+	}
+	std::cout << "threads " << threads << (sharded ? " sharded" : " shared")
+		<< (backend == IOManager::IO_URING ? " io_uring" : backend == IOManager::EPOLL_PERSISTENT ? " epoll persistent" : " epoll") << ": "
+		<< std::chrono::duration<double, std::micro>(end - start).count() / N << " us rtt" << std::endl;
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include "ioscheduler_ly.h"
+#include "hook_ly.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <vector>
+
+using namespace sylar;
+
+// 指定线程的任务: 10万个任务轮流指定给4个worker, 并检查每个任务都在指定的线程上运行
+// 只用到原有的接口, 在改动前的树上也能编译, 用来对比
+
+static const long N = 100000;
+
+static std::atomic<long> s_done{0};
+static std::atomic<long> s_wrong{0};
+static std::chrono::steady_clock::time_point s_end;
+
+int main()
+{
+	std::chrono::steady_clock::time_point start;
+	{
+		IOManager iom(4);
+		iom.scheduleLock([&start](){
+			// 先找出各worker的线程id
+			std::set<int> tids;
+			std::mutex mutex;
+			std::atomic<int> seen{0};
+			for(int i = 0; i < 200; i++)
+			{
+				IOManager::GetThis()->scheduleLock([&](){
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						tids.insert(Thread::GetThreadId());
+					}
+					seen++;
+					usleep(100);
+				});
+			}
+			while(seen < 200)
+			{
+				usleep(1000);
+			}
+			std::vector<int> workers(tids.begin(), tids.end());
+
+			start = std::chrono::steady_clock::now();
+			for(long i = 0; i < N; i++)
+			{
+				int tid = workers[i % workers.size()];
+				IOManager::GetThis()->scheduleLock([tid](){
+					if(Thread::GetThreadId() != tid)
+					{
+						s_wrong++;
+					}
+					if(++s_done == N)
+					{
+						s_end = std::chrono::steady_clock::now();
+					}
+				}, tid);
+				if(i % 256 == 255)
+				{
+					IOManager::GetThis()->scheduleLock(Fiber::GetThis());
+					Fiber::GetThis()->yield();
+				}
+			}
+		});
+	}
+	std::cout << "pinned tasks: " << s_done << " done, " << s_wrong << " on the wrong thread, "
+		<< std::chrono::duration<double, std::milli>(s_end - start).count() << " ms" << std::endl;
+	return 0;
+}
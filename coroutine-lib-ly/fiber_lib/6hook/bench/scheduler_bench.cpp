@@ -0,0 +1,89 @@
+#include "ioscheduler_ly.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+using namespace sylar;
+
+// 调度吞吐: 每个worker上的协程不断scheduleLock短任务, 1/2/4/8个线程
+// 只用到原有的接口, 在改动前的树上也能编译, 用来对比
+
+static const long N = 400000;
+
+static std::atomic<long> s_allocs{0};
+static std::atomic<long> s_done{0};
+static std::chrono::steady_clock::time_point s_end;
+
+// 统计每个任务的堆分配次数
+void* operator new(size_t n)
+{
+	s_allocs.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(n);
+	if(!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+static void work()
+{
+	volatile int x = 0;
+	for(int i = 0; i < 200; i++)
+	{
+		x += i;
+	}
+	if(++s_done == N)
+	{
+		s_end = std::chrono::steady_clock::now();
+	}
+}
+
+static void spawner(long count)
+{
+	for(long i = 0; i < count; i++)
+	{
+		IOManager::GetThis()->scheduleLock(&work);
+		// 时常让出, 让其他任务和窃取有机会运行
+		if(i % 256 == 255)
+		{
+			IOManager::GetThis()->scheduleLock(Fiber::GetThis());
+			Fiber::GetThis()->yield();
+		}
+	}
+}
+
+int main()
+{
+	for(int threads : {1, 2, 4, 8})
+	{
+		s_done = 0;
+		long allocs = 0;
+		auto start = std::chrono::steady_clock::now();
+		{
+			IOManager iom(threads);
+			allocs = s_allocs;
+			for(int i = 0; i < threads; i++)
+			{
+				iom.scheduleLock([threads](){ spawner(N / threads); });
+			}
+		}
+		double us = std::chrono::duration<double, std::micro>(s_end - start).count();
+		std::cout << "threads " << threads << ": " << N / us << " Mtask/s, "
+			<< (double)(s_allocs - allocs) / N << " allocs/task" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,54 @@
+#include "ioscheduler_ly.h"
+#include "hook_ly.h"
+
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+using namespace sylar;
+
+// 大量协程挂在sleep()上时每个协程的常驻内存
+// 参数 shared -> 共享栈模式, 默认是独立的mmap栈
+
+static const int N = 20000;
+
+static std::atomic<int> s_count{0};
+static long s_base = 0;
+static long s_peak = 0;
+
+static long rss()
+{
+	std::ifstream f("/proc/self/statm");
+	long size = 0;
+	long resident = 0;
+	f >> size >> resident;
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+int main(int argc, char** argv)
+{
+	bool shared = argc > 1 && strcmp(argv[1], "shared") == 0;
+	s_base = rss();
+	{
+		IOManager iom(1);
+		iom.setSharedStack(shared);
+		for(int i = 0; i < N; i++)
+		{
+			iom.scheduleLock([](){
+				char buf[1500];
+				memset(buf, 1, sizeof(buf));
+				asm volatile("" : : "r"(buf) : "memory");
+				// 最后一个协程挂起前所有协程都已在sleep中
+				if(++s_count == N)
+				{
+					s_peak = rss();
+				}
+				sleep(1);
+			});
+		}
+	}
+	std::cout << (shared ? "shared" : "private") << ": " << (s_peak - s_base) / N << " bytes rss/fiber" << std::endl;
+	return 0;
+}
@@ -0,0 +1,49 @@
+#include "ioscheduler_ly.h"
+#include "hook_ly.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+using namespace sylar;
+
+// hook的usleep比要求多睡了多久: 4个协程各usleep 200次, 2个worker
+// 参数 hires -> IOManager::setHighResTimer(true)
+
+int main(int argc, char** argv)
+{
+	bool hires = argc > 1 && strcmp(argv[1], "hires") == 0;
+	printf("%s\n", hires ? "high-res" : "default");
+	for(int us : {100, 200, 500, 1000, 5000})
+	{
+		std::vector<double> late;
+		std::mutex mutex;
+		{
+			IOManager iom(2);
+			iom.setHighResTimer(hires);
+			for(int f = 0; f < 4; f++)
+			{
+				iom.scheduleLock([&, us](){
+					std::vector<double> local;
+					for(int i = 0; i < 200; i++)
+					{
+						auto start = std::chrono::steady_clock::now();
+						usleep(us);
+						local.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() - us);
+					}
+					std::lock_guard<std::mutex> lock(mutex);
+					late.insert(late.end(), local.begin(), local.end());
+				});
+			}
+		}
+		std::sort(late.begin(), late.end());
+		auto pct = [&late](double q){
+			return late[std::min(late.size() - 1, (size_t)(q * late.size()))];
+		};
+		printf("usleep(%d) lateness us: p50 %.1f p90 %.1f p99 %.1f\n", us, pct(0.5), pct(0.9), pct(0.99));
+	}
+	return 0;
+}
@@ -0,0 +1,55 @@
+#include "fiber_ly.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+
+using namespace sylar;
+
+// 挂起的协程每个占多少常驻内存: 每个协程在栈上用约2KB后yield
+// 参数 malloc -> 旧的malloc栈, 默认是mmap栈
+
+static const int N = 10000;
+
+static long rss()
+{
+	std::ifstream f("/proc/self/statm");
+	long size = 0;
+	long resident = 0;
+	f >> size >> resident;
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+int main(int argc, char** argv)
+{
+	bool use_malloc = argc > 1 && strcmp(argv[1], "malloc") == 0;
+	StackAllocator::SetDefaultBackend(use_malloc ? StackAllocator::MALLOC : StackAllocator::MMAP);
+	Fiber::GetThis();
+
+	std::vector<std::shared_ptr<Fiber>> fibers;
+	fibers.reserve(N);
+	long before = rss();
+	for(int i = 0; i < N; i++)
+	{
+		fibers.push_back(std::make_shared<Fiber>([](){
+			char buf[2000];
+			memset(buf, 1, sizeof(buf));
+			// 防止buf被优化掉
+			asm volatile("" : : "r"(buf) : "memory");
+			Fiber::GetThis()->yield();
+		}, 0, false));
+		fibers.back()->resume();
+	}
+	long after = rss();
+
+	std::cout << (use_malloc ? "malloc" : "mmap") << ": " << (after - before) / N << " bytes rss/fiber" << std::endl;
+
+	// 让协程跑完再析构
+	for(auto& f : fibers)
+	{
+		f->resume();
+	}
+	return 0;
+}
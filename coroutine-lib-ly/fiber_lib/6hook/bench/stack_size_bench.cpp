@@ -0,0 +1,46 @@
+#include "stack_profiler_ly.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace sylar;
+
+// 自动栈大小每次建协程前的查询开销: GetStackSize(GetTag(cb)), 1个和4个线程
+
+static const long N = 2000000;
+
+int main()
+{
+	StackProfiler::SetAutoSize(true);
+	std::function<void()> cb = [](){};
+	StackProfiler::Record(StackProfiler::GetTag(cb), 3000);
+
+	for(int threads : {1, 4})
+	{
+		std::atomic<size_t> sink{0};
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> workers;
+		for(int t = 0; t < threads; t++)
+		{
+			workers.emplace_back([&](){
+				size_t s = 0;
+				for(long i = 0; i < N; i++)
+				{
+					s += StackProfiler::GetStackSize(StackProfiler::GetTag(cb));
+				}
+				sink += s;
+			});
+		}
+		for(auto& w : workers)
+		{
+			w.join();
+		}
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "threads " << threads << ": " << ns / N << " ns per lookup (wall time per iteration)" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,39 @@
+#include "fiber_ly.h"
+
+#include <chrono>
+#include <iostream>
+
+using namespace sylar;
+
+// 协程切换开销: 主协程和一个子协程来回切换
+// 默认是汇编后端, 加 -DSYLAR_FIBER_UCONTEXT 编译得到ucontext后端的数字
+
+static const long N = 5000000;
+
+int main()
+{
+	Fiber::GetThis();
+
+	std::shared_ptr<Fiber> fiber = std::make_shared<Fiber>([](){
+		for(long i = 0; i < N; i++)
+		{
+			Fiber::GetThis()->yield();
+		}
+	}, 0, false);
+
+	auto start = std::chrono::steady_clock::now();
+	// N次yield + N+1次resume
+	for(long i = 0; i <= N; i++)
+	{
+		fiber->resume();
+	}
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+#ifdef SYLAR_FIBER_UCONTEXT
+	std::cout << "ucontext: ";
+#else
+	std::cout << "asm: ";
+#endif
+	std::cout << ns / (2 * N + 1) << " ns/switch" << std::endl;
+	return 0;
+}
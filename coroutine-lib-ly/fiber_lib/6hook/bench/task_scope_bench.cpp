@@ -0,0 +1,112 @@
+#include "ioscheduler_ly.h"
+#include "task_scope_ly.h"
+#include "future_ly.h"
+#include "hook_ly.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+using namespace sylar;
+
+// WaitGroup等待100个hook后的10ms任务, 一个子任务失败时兄弟任务多快停下
+// 以及TaskScope对比WaitGroup + scheduleLock的spawn+join开销
+// 参数: 线程数, 默认4
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	int threads = argc > 1 ? atoi(argv[1]) : 4;
+	set_hook_enable(false);
+
+	IOManager iom(threads);
+	Spawn([](){
+		{
+			WaitGroup wg;
+			std::atomic<int> n{0};
+			auto start = std::chrono::steady_clock::now();
+			for(int i = 0; i < 100; i++)
+			{
+				wg.add();
+				IOManager::GetThis()->scheduleLock([&](){
+					usleep(10000);
+					n++;
+					wg.done();
+				});
+			}
+			wg.wait();
+			std::cout << "WaitGroup over 100 x 10ms: " << elapsedMs(start) << " ms (" << n << " done)" << std::endl;
+		}
+
+		{
+			std::atomic<int> finished{0}, cancelled{0};
+			auto start = std::chrono::steady_clock::now();
+			TaskScope scope;
+			for(int i = 0; i < 50; i++)
+			{
+				scope.spawn([&, i](){
+					if(i == 3)
+					{
+						usleep(1000);
+						throw std::runtime_error("child 3 failed");
+					}
+					for(int k = 0; k < 100; k++)
+					{
+						if(scope.isCancelled())
+						{
+							cancelled++;
+							return;
+						}
+						usleep(1000);
+					}
+					finished++;
+				});
+			}
+			try
+			{
+				scope.join();
+			}
+			catch(const std::exception& e)
+			{
+				std::cout << "'" << e.what() << "' rethrown after " << elapsedMs(start) << " ms, "
+					<< cancelled << " siblings cancelled, " << finished << " finished" << std::endl;
+			}
+		}
+
+		const int N = 100000;
+		std::atomic<long> sum{0};
+		auto start = std::chrono::steady_clock::now();
+		for(int b = 0; b < N / 100; b++)
+		{
+			TaskScope scope;
+			for(int i = 0; i < 100; i++)
+			{
+				scope.spawn([&sum, i](){ sum += i; });
+			}
+		}
+		std::cout << "TaskScope spawn + join: " << elapsedMs(start) * 1000 / N << " us/task" << std::endl;
+
+		start = std::chrono::steady_clock::now();
+		for(int b = 0; b < N / 100; b++)
+		{
+			WaitGroup wg;
+			for(int i = 0; i < 100; i++)
+			{
+				wg.add();
+				IOManager::GetThis()->scheduleLock([&sum, &wg, i](){
+					sum += i;
+					wg.done();
+				});
+			}
+			wg.wait();
+		}
+		std::cout << "WaitGroup + scheduleLock: " << elapsedMs(start) * 1000 / N << " us/task" << std::endl;
+	}, &iom).join();
+	return 0;
+}
@@ -0,0 +1,109 @@
+#include "ioscheduler_ly.h"
+#include "hook_ly.h"
+#include "fd_manager_ly.h"
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+using namespace sylar;
+
+// 带超时的hook recv的开销: 1个worker上socketpair乒乓, SO_RCVTIMEO = 1s, 每次recv都先EAGAIN再等待
+// 统计每次recv的堆分配次数和耗时
+// 参数: [uring] [notimeout]
+
+static std::atomic<long> s_allocs{0};
+
+void* operator new(size_t n)
+{
+	s_allocs.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(n);
+	if(!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+int main(int argc, char** argv)
+{
+	bool uring = false;
+	bool timeout = true;
+	for(int i = 1; i < argc; i++)
+	{
+		uring = uring || strcmp(argv[i], "uring") == 0;
+		timeout = timeout && strcmp(argv[i], "notimeout") != 0;
+	}
+
+	// 每轮两次recv
+	const long ROUNDS = 500000;
+	const long WARMUP = 1000;
+	int sv[2];
+	socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+	FdMgr::GetInstance()->get(sv[0], true);
+	FdMgr::GetInstance()->get(sv[1], true);
+
+	long a0 = 0;
+	long a1 = 0;
+	std::chrono::steady_clock::time_point t0;
+	std::chrono::steady_clock::time_point t1;
+	{
+		IOManager iom(1, true, "IOManager", false, uring ? IOManager::IO_URING : IOManager::EPOLL);
+		iom.scheduleLock([&](){
+			if(timeout)
+			{
+				timeval tv{1, 0};
+				setsockopt(sv[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+				setsockopt(sv[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+			}
+			IOManager::GetThis()->scheduleLock([&](){
+				char c;
+				for(long i = 0; i < ROUNDS; i++)
+				{
+					if(recv(sv[0], &c, 1, 0) != 1)
+					{
+						abort();
+					}
+					send(sv[0], &c, 1, 0);
+				}
+			});
+			char c = 'x';
+			for(long i = 0; i < ROUNDS; i++)
+			{
+				// 预热后开始计数
+				if(i == WARMUP)
+				{
+					a0 = s_allocs;
+					t0 = std::chrono::steady_clock::now();
+				}
+				send(sv[1], &c, 1, 0);
+				if(recv(sv[1], &c, 1, 0) != 1)
+				{
+					abort();
+				}
+			}
+			a1 = s_allocs;
+			t1 = std::chrono::steady_clock::now();
+		});
+	}
+	long ops = (ROUNDS - WARMUP) * 2;
+	std::cout << (uring ? "io_uring" : "epoll") << (timeout ? " SO_RCVTIMEO 1s" : " no timeout") << ": "
+		<< (double)(a1 - a0) / ops << " allocs/recv, "
+		<< std::chrono::duration<double, std::nano>(t1 - t0).count() / ops << " ns/recv" << std::endl;
+	return 0;
+}
@@ -0,0 +1,102 @@
+#include "timer_ly.h"
+#include "hook_ly.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+using namespace sylar;
+
+// 嵌入式TimerEntry对比addConditionTimer: 已有10万个timer时添加后立即取消, 统计耗时和堆分配次数
+// 堆和时间轮各跑一遍
+
+static const long N = 1000000;
+
+static std::atomic<long> s_allocs{0};
+
+void* operator new(size_t n)
+{
+	s_allocs.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(n);
+	if(!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+// 连接对象里嵌入的超时
+struct Conn
+{
+	TimerEntry deadline;
+	long timeouts = 0;
+
+	Conn() : deadline(&Conn::OnTimeout, this) {}
+
+	static void OnTimeout(void* arg)
+	{
+		static_cast<Conn*>(arg)->timeouts++;
+	}
+};
+
+int main()
+{
+	// 只用TimerManager, 不需要hook
+	set_hook_enable(false);
+	for(TimerManager::QueueType type : {TimerManager::HEAP, TimerManager::WHEEL})
+	{
+		TimerManager::SetDefaultQueue(type);
+		TimerManager manager;
+		// 背景负载
+		std::vector<std::shared_ptr<Timer>> background;
+		for(int i = 0; i < 100000; i++)
+		{
+			background.push_back(manager.addTimer(10000 + i % 50000, [](){}));
+		}
+
+		Conn conn;
+		long a0 = s_allocs;
+		auto t0 = std::chrono::steady_clock::now();
+		for(long i = 0; i < N; i++)
+		{
+			manager.addTimer(conn.deadline, std::chrono::seconds(30));
+			conn.deadline.cancel();
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		long a1 = s_allocs;
+
+		std::shared_ptr<int> cond = std::make_shared<int>(0);
+		std::weak_ptr<int> weak_cond(cond);
+		long a2 = s_allocs;
+		auto t2 = std::chrono::steady_clock::now();
+		for(long i = 0; i < N; i++)
+		{
+			std::shared_ptr<Timer> timer = manager.addConditionTimer(30000, [&conn](){ conn.timeouts++; }, weak_cond);
+			timer->cancel();
+		}
+		// 不在worker上取消只是挂到取消链表, 下次取timer时才从队列删除, 这部分也算在取消上
+		manager.getNextTimer();
+		auto t3 = std::chrono::steady_clock::now();
+		long a3 = s_allocs;
+
+		std::cout << (type == TimerManager::HEAP ? "heap: " : "wheel: ")
+			<< "TimerEntry add+cancel " << std::chrono::duration<double, std::nano>(t1 - t0).count() / N << " ns, "
+			<< (double)(a1 - a0) / N << " allocs; addConditionTimer+cancel "
+			<< std::chrono::duration<double, std::nano>(t3 - t2).count() / N << " ns, "
+			<< (double)(a3 - a2) / N << " allocs" << std::endl;
+	}
+	return 0;
+}
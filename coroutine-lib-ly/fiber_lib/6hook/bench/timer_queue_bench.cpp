@@ -0,0 +1,99 @@
+#include "timer_ly.h"
+#include "hook_ly.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace sylar;
+
+// timer队列: 在已有N个活跃timer时的插入, 取消后重加, refresh和getNextTimer, 以及N个timer一起到期时的listExpiredCb
+// 两种队列(堆和时间轮)各跑一遍, N = 10k / 100k / 1M
+
+typedef std::chrono::steady_clock Clock;
+
+static const long OPS = 200000;
+
+template <class F>
+static double nsPerOp(long count, F f)
+{
+	Clock::time_point start = Clock::now();
+	for(long i = 0; i < count; i++)
+	{
+		f(i);
+	}
+	return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / count;
+}
+
+static void run(TimerManager::QueueType type, long n)
+{
+	TimerManager::SetDefaultQueue(type);
+	std::mt19937_64 rng(n);
+	std::vector<std::shared_ptr<Timer>> timers;
+	timers.reserve(n);
+	double insert = 0;
+	double cancelAdd = 0;
+	double refresh = 0;
+	double next = 0;
+	double expire = 0;
+	{
+		TimerManager manager;
+		// 1-600s后到期
+		insert = nsPerOp(n, [&](long){
+			timers.push_back(manager.addTimer(1000 + rng() % 599000, [](){}));
+		});
+		cancelAdd = nsPerOp(OPS, [&](long i){
+			std::shared_ptr<Timer>& t = timers[rng() % n];
+			t->cancel();
+			t = manager.addTimer(1000 + rng() % 599000, [](){});
+			// 不在worker上取消只是挂到取消链表, 下次取timer时才从队列删除, 这部分也算在取消上
+			if(i == OPS - 1)
+			{
+				manager.getNextTimer();
+			}
+		});
+		refresh = nsPerOp(OPS, [&](long){
+			timers[rng() % n]->refresh();
+		});
+		next = nsPerOp(OPS, [&](long){
+			manager.getNextTimer();
+		});
+		timers.clear();
+	}
+	{
+		TimerManager manager;
+		for(long i = 0; i < n; i++)
+		{
+			manager.addTimer(std::chrono::microseconds(rng() % 200000), [](){});
+		}
+		// 等全部到期后一次取出
+		usleep(250000);
+		std::vector<std::function<void()>> cbs;
+		cbs.reserve(n);
+		Clock::time_point start = Clock::now();
+		manager.listExpiredCb(cbs);
+		expire = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / n;
+		if((long)cbs.size() != n)
+		{
+			std::cerr << "expired " << cbs.size() << " of " << n << std::endl;
+		}
+	}
+	std::cout << (type == TimerManager::HEAP ? "heap " : "wheel") << " n " << n << ": insert " << insert
+		<< " ns, cancel+add " << cancelAdd << " ns, refresh " << refresh << " ns, getNextTimer " << next
+		<< " ns, expire " << expire << " ns/timer" << std::endl;
+}
+
+int main()
+{
+	// 只用TimerManager, 不需要hook
+	set_hook_enable(false);
+	for(TimerManager::QueueType type : {TimerManager::HEAP, TimerManager::WHEEL})
+	{
+		for(long n : {10000L, 100000L, 1000000L})
+		{
+			run(type, n);
+		}
+	}
+	return 0;
+}
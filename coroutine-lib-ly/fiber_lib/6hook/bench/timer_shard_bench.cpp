@@ -0,0 +1,81 @@
+#include "ioscheduler_ly.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace sylar;
+
+// 多个worker同时添加并取消timer: 1/2/4/8个线程, 每个worker上的协程做addConditionTimer+cancel
+// 以及在非worker线程上取消worker添加的timer
+// 只用到原有的接口, 在改动前的树上也能编译, 用来对比
+
+static const long N = 400000;
+
+int main()
+{
+	for(int threads : {1, 2, 4, 8})
+	{
+		std::atomic<int> finished{0};
+		auto start = std::chrono::steady_clock::now();
+		std::chrono::steady_clock::time_point end;
+		// 要比IOManager活得久: 析构时调用方线程才开始运行任务
+		std::shared_ptr<int> cond = std::make_shared<int>(0);
+		{
+			IOManager iom(threads);
+			for(int t = 0; t < threads; t++)
+			{
+				iom.scheduleLock([&, threads](){
+					for(long i = 0; i < N / threads; i++)
+					{
+						std::shared_ptr<Timer> timer = IOManager::GetThis()->addConditionTimer(1000, [](){}, cond);
+						timer->cancel();
+						if(i % 1024 == 1023)
+						{
+							IOManager::GetThis()->scheduleLock(Fiber::GetThis());
+							Fiber::GetThis()->yield();
+						}
+					}
+					if(++finished == threads)
+					{
+						end = std::chrono::steady_clock::now();
+					}
+				});
+			}
+		}
+		std::cout << "threads " << threads << ": add+cancel "
+			<< std::chrono::duration<double, std::nano>(end - start).count() / N << " ns/op" << std::endl;
+	}
+
+	// 在worker上添加, 在主线程取消
+	{
+		IOManager iom(2);
+		std::vector<std::shared_ptr<Timer>> timers(N);
+		std::atomic<int> ready{0};
+		for(int w = 0; w < 2; w++)
+		{
+			iom.scheduleLock([&, w](){
+				for(long i = w; i < N; i += 2)
+				{
+					timers[i] = IOManager::GetThis()->addTimer(1000, [](){});
+				}
+				ready++;
+			});
+		}
+		while(ready < 2)
+		{
+			std::this_thread::yield();
+		}
+		auto start = std::chrono::steady_clock::now();
+		for(auto& t : timers)
+		{
+			t->cancel();
+		}
+		std::cout << "remote cancel: " << std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / N
+			<< " ns/op" << std::endl;
+		timers.clear();
+	}
+	return 0;
+}
@@ -0,0 +1,63 @@
+#include "ioscheduler_ly.h"
+#include "hook_ly.h"
+
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+
+using namespace sylar;
+
+// timer slack合并唤醒的效果: 10万个一次性timer的到期时间均匀分布在4秒内, 精度到微秒
+// 用自愿上下文切换次数近似worker的唤醒次数, slack分别为0, 1ms, 10ms
+// 参数: [hires] [线程数, 默认1]
+
+static std::atomic<long> s_fired{0};
+
+static double seconds(const timeval& t)
+{
+	return t.tv_sec + t.tv_usec / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+	// 主线程用真正的sleep
+	set_hook_enable(false);
+	bool hires = argc > 1 && strcmp(argv[1], "hires") == 0;
+	int threads = argc > 2 ? atoi(argv[2]) : 1;
+	const int N = 100000;
+	const int SPAN_US = 4000000;
+
+	for(int slack_us : {0, 1000, 10000})
+	{
+		s_fired = 0;
+		rusage r0;
+		rusage r1;
+		std::chrono::steady_clock::time_point start;
+		{
+			IOManager iom(threads);
+			iom.setHighResTimer(hires);
+			iom.setTimerSlack(std::chrono::microseconds(slack_us));
+			std::mt19937 rng(7);
+			for(int i = 0; i < N; i++)
+			{
+				iom.addTimer(std::chrono::microseconds(200000 + rng() % SPAN_US), [](){ s_fired++; });
+			}
+			// 跳过启动阶段
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			getrusage(RUSAGE_SELF, &r0);
+			start = std::chrono::steady_clock::now();
+		}
+		getrusage(RUSAGE_SELF, &r1);
+		double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double cpu = seconds(r1.ru_utime) + seconds(r1.ru_stime) - seconds(r0.ru_utime) - seconds(r0.ru_stime);
+		std::cout << (hires ? "high-res" : "default") << " slack " << slack_us << " us: fired " << s_fired
+			<< ", " << (r1.ru_nvcsw - r0.ru_nvcsw) / wall << " wakeups/s, cpu " << 100 * cpu / wall << "%" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,132 @@
+#include "ioscheduler_ly.h"
+#include "hook_ly.h"
+#include "fd_manager_ly.h"
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <poll.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+using namespace sylar;
+
+// 空闲worker的唤醒: socket乒乓的往返时间, 外部线程投递任务的唤醒延迟, 大量短任务的吞吐
+// 参数: 线程数, 默认4
+// 只用到原有的接口, 在改动前的树上也能编译, 用来对比
+
+typedef std::chrono::steady_clock Clock;
+
+// 自愿和非自愿的上下文切换次数
+static long csw()
+{
+	rusage r;
+	getrusage(RUSAGE_SELF, &r);
+	return r.ru_nvcsw + r.ru_nivcsw;
+}
+
+static void pingPong(int threads)
+{
+	const long N = 20000;
+	Clock::time_point start;
+	Clock::time_point end;
+	long c0 = csw();
+	{
+		IOManager iom(threads);
+		iom.scheduleLock([&](){
+			int sv[2];
+			socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+			// socketpair没有hook, 手动登记让recv/send走协程等待
+			FdMgr::GetInstance()->get(sv[0], true);
+			FdMgr::GetInstance()->get(sv[1], true);
+			int a = sv[0];
+			int b = sv[1];
+			IOManager::GetThis()->scheduleLock([b, N](){
+				char c;
+				for(long i = 0; i < N; i++)
+				{
+					recv(b, &c, 1, 0);
+					send(b, &c, 1, 0);
+				}
+			});
+			char c = 'x';
+			start = Clock::now();
+			for(long i = 0; i < N; i++)
+			{
+				send(a, &c, 1, 0);
+				recv(a, &c, 1, 0);
+			}
+			end = Clock::now();
+			close(a);
+			close(b);
+		});
+	}
+	std::cout << "ping-pong rtt: " << std::chrono::duration<double, std::micro>(end - start).count() / N << " us, "
+		<< (double)(csw() - c0) / N << " csw/rtt" << std::endl;
+}
+
+static void wakeLatency(int threads)
+{
+	const int N = 2000;
+	double total = 0;
+	long c0 = 0;
+	long c1 = 0;
+	{
+		IOManager iom(threads);
+		std::thread outside([&](){
+			// 外部线程不走hook
+			set_hook_enable(false);
+			// 等worker都空闲下来
+			poll(nullptr, 0, 50);
+			c0 = csw();
+			for(int i = 0; i < N; i++)
+			{
+				std::atomic<bool> ran{false};
+				Clock::time_point t1;
+				Clock::time_point t0 = Clock::now();
+				iom.scheduleLock([&](){
+					t1 = Clock::now();
+					ran = true;
+				});
+				while(!ran)
+				{
+					std::this_thread::yield();
+				}
+				total += std::chrono::duration<double, std::micro>(t1 - t0).count();
+				poll(nullptr, 0, 1);
+			}
+			c1 = csw();
+		});
+		outside.join();
+	}
+	std::cout << "wakeup latency: " << total / N << " us, " << (double)(c1 - c0) / N << " csw/task" << std::endl;
+}
+
+static void shortTasks(int threads)
+{
+	const long N = 200000;
+	std::atomic<long> done{0};
+	Clock::time_point start = Clock::now();
+	{
+		IOManager iom(threads);
+		for(long i = 0; i < N; i++)
+		{
+			iom.scheduleLock([&done](){ done++; });
+		}
+	}
+	double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	std::cout << "short tasks: " << us / N << " us/task" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	int threads = argc > 1 ? atoi(argv[1]) : 4;
+	std::cout << "threads " << threads << std::endl;
+	pingPong(threads);
+	wakeLatency(threads);
+	shortTasks(threads);
+	return 0;
+}
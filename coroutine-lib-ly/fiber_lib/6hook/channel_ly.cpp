@@ -0,0 +1,236 @@
+#include "channel_ly.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace sylar {
+
+void ChannelBase::close()
+{
+    m_closed = true;
+
+    // 先置关闭标志再唤醒: 等待者入队后会再检查一次关闭标志, 不会漏掉
+    std::vector<FiberWaiter> woken;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(WaitQueue* queue : {&m_senders, &m_receivers})
+        {
+            while(queue->head)
+            {
+                SelectCase* c = queue->head;
+                queue->head = c->next;
+                c->queued = false;
+                queue->waiting--;
+                if(!c->waiter->claimed.exchange(true))
+                {
+                    woken.push_back(c->waiter->waiter);
+                }
+            }
+            queue->tail = nullptr;
+        }
+    }
+    for(FiberWaiter& waiter : woken)
+    {
+        waiter.wake();
+    }
+}
+
+void ChannelBase::notifySlow(WaitQueue& queue)
+{
+    FiberWaiter waiter;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while(true)
+        {
+            SelectCase* c = queue.head;
+            if(!c)
+            {
+                return;
+            }
+            queue.head = c->next;
+            if(queue.head)
+            {
+                queue.head->prev = nullptr;
+            }
+            else
+            {
+                queue.tail = nullptr;
+            }
+            c->queued = false;
+            queue.waiting--;
+
+            // 已被其他通道认领的Select等待者直接出队, 继续找下一个
+            if(!c->waiter->claimed.exchange(true))
+            {
+                // 拷贝出来再唤醒: 被唤醒者返回后c和它的等待者都会失效
+                waiter = c->waiter->waiter;
+                break;
+            }
+        }
+    }
+    waiter.wake();
+}
+
+void ChannelBase::enqueue(SelectCase& c)
+{
+    WaitQueue& queue = c.send ? m_senders : m_receivers;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    c.prev = queue.tail;
+    c.next = nullptr;
+    if(queue.tail)
+    {
+        queue.tail->next = &c;
+    }
+    else
+    {
+        queue.head = &c;
+    }
+    queue.tail = &c;
+    c.queued = true;
+    queue.waiting++;
+}
+
+void ChannelBase::dequeue(SelectCase& c)
+{
+    WaitQueue& queue = c.send ? m_senders : m_receivers;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!c.queued)
+    {
+        return;
+    }
+    if(c.prev)
+    {
+        c.prev->next = c.next;
+    }
+    else
+    {
+        queue.head = c.next;
+    }
+    if(c.next)
+    {
+        c.next->prev = c.prev;
+    }
+    else
+    {
+        queue.tail = c.prev;
+    }
+    c.queued = false;
+    queue.waiting--;
+}
+
+// 依次尝试各分支, open返回是否还有没关闭的分支
+static int TryCases(SelectCase* cases, size_t count, size_t start, bool& open)
+{
+    open = false;
+    for(size_t i = 0; i < count; i++)
+    {
+        size_t idx = (start + i) % count;
+        SelectCase& c = cases[idx];
+        // 先读关闭标志再尝试 -> 关闭前发送的数据仍能收到
+        bool closed = c.channel->isClosed();
+        if(c.tryOp(c))
+        {
+            return (int)idx;
+        }
+        if(!closed)
+        {
+            open = true;
+        }
+    }
+    return -1;
+}
+
+// 挂起期间挂在通道等待队列上的状态
+struct SelectWait
+{
+    ChannelWaiter waiter;
+    Semaphore sem;
+};
+
+int Select(SelectCase* cases, size_t count, bool block)
+{
+    // 轮换起始分支, 多个分支同时就绪时不会总选第一个
+    static thread_local size_t t_start = 0;
+    size_t start = count > 1 ? t_start++ % count : 0;
+
+    SelectWait local_wait;
+    SelectWait* wait = &local_wait;
+    // 入队的节点, 默认就是调用方的分支
+    SelectCase* nodes = cases;
+    std::unique_ptr<SelectWait> heap_wait;
+    std::unique_ptr<SelectCase[]> heap_nodes;
+    bool prepared = false;
+    bool woken = false;
+    int done = -1;
+    while(true)
+    {
+        bool open = false;
+        done = TryCases(nodes, count, start, open);
+        if(done >= 0 || !open || !block)
+        {
+            break;
+        }
+
+        if(!prepared)
+        {
+            // 共享栈协程挂起后栈被其他协程覆盖, 而等待者和节点仍在通道的等待队列上 -> 放到堆上
+            // 只在第一次挂起前分配, 能立即完成时不分配
+            if(Fiber::GetThis()->isSharedStack())
+            {
+                heap_wait.reset(new SelectWait());
+                heap_nodes.reset(new SelectCase[count]);
+                std::copy(cases, cases + count, heap_nodes.get());
+                wait = heap_wait.get();
+                nodes = heap_nodes.get();
+            }
+            wait->waiter.waiter.prepare(&wait->sem);
+            prepared = true;
+        }
+        wait->waiter.claimed = false;
+        for(size_t i = 0; i < count; i++)
+        {
+            nodes[i].waiter = &wait->waiter;
+            nodes[i].channel->enqueue(nodes[i]);
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // 入队后再试一次: 入队前完成的send/recv/close不会再唤醒自己
+        done = TryCases(nodes, count, start, open);
+        if(done >= 0 || !open)
+        {
+            // 撤销等待, 已被认领 -> 唤醒已经在路上, 先等它到达
+            if(wait->waiter.claimed.exchange(true))
+            {
+                wait->waiter.waiter.wait();
+                woken = true;
+            }
+            for(size_t i = 0; i < count; i++)
+            {
+                nodes[i].channel->dequeue(nodes[i]);
+            }
+            break;
+        }
+
+        wait->waiter.waiter.wait();
+        woken = true;
+        for(size_t i = 0; i < count; i++)
+        {
+            nodes[i].channel->dequeue(nodes[i]);
+        }
+    }
+
+    // 被某个通道唤醒却完成了另一个分支(或没有完成) -> 把唤醒转给其他分支上的等待者, 避免它们错过数据
+    if(woken)
+    {
+        for(size_t i = 0; i < count; i++)
+        {
+            if((int)i != done)
+            {
+                nodes[i].channel->notify(nodes[i].send);
+            }
+        }
+    }
+    return done;
+}
+
+}
@@ -0,0 +1,309 @@
+#ifndef _CHANNEL_LY_H_
+#define _CHANNEL_LY_H_
+
+#include "fiber_sync_ly.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace sylar
+{
+
+// 有界多生产者多消费者通道
+// 数据存放在无锁环形队列中, 不满/不空时send/recv只有几次原子操作, 不加锁也不分配内存
+// 满/空时挂起当前协程(不在调度器协程中时阻塞线程), 对端操作后唤醒一个等待者重新竞争
+// close()之后send失败, 已发送的数据仍可以recv, 取完后recv失败
+
+class ChannelBase;
+
+// Select的等待者: 同一个等待者挂在多个通道上, 第一个唤醒它的通道认领(claimed)
+struct ChannelWaiter
+{
+    FiberWaiter waiter;
+    std::atomic<bool> claimed = {false};
+};
+
+// Select的一个分支, 由Channel::sendCase/recvCase构造
+struct SelectCase
+{
+    ChannelBase* channel = nullptr;
+    bool send = false;
+    // 不阻塞地尝试这个分支
+    bool (*tryOp)(SelectCase& c) = nullptr;
+    // send: 要发送的值(成功时被移走) recv: 接收到的值写到这里
+    void* item = nullptr;
+
+    // 以下由Select使用: 分支本身就是通道等待队列的节点, 挂起时不分配内存(共享栈协程上拷贝到堆上)
+    ChannelWaiter* waiter = nullptr;
+    SelectCase* prev = nullptr;
+    SelectCase* next = nullptr;
+    bool queued = false;
+};
+
+// 等待任意一个分支完成, 返回完成的分支下标
+// 已关闭的通道上的分支不再参与(recv分支在数据取完之后), 全部关闭时返回-1
+// block为false时没有可以立即完成的分支返回-1
+int Select(SelectCase* cases, size_t count, bool block = true);
+
+template<size_t N>
+int Select(SelectCase (&cases)[N], bool block = true)
+{
+    return Select(cases, N, block);
+}
+
+class ChannelBase
+{
+public:
+    ChannelBase(const ChannelBase&) = delete;
+    ChannelBase& operator=(const ChannelBase&) = delete;
+
+    // 唤醒所有等待者
+    void close();
+    bool isClosed() const {return m_closed;}
+
+protected:
+    ChannelBase() = default;
+    ~ChannelBase() = default;
+
+    // 唤醒一个发送/接收等待者, 在放入/取出数据之后调用
+    void notify(bool senders)
+    {
+        WaitQueue& queue = senders ? m_senders : m_receivers;
+        // 和等待者的入队计数配对: 两者至少有一方看到对方
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(queue.waiting.load(std::memory_order_relaxed) == 0)
+        {
+            return;
+        }
+        notifySlow(queue);
+    }
+
+private:
+    // 侵入式等待队列, 节点是SelectCase
+    struct WaitQueue
+    {
+        std::atomic<size_t> waiting = {0};
+        SelectCase* head = nullptr;
+        SelectCase* tail = nullptr;
+    };
+
+    void notifySlow(WaitQueue& queue);
+    void enqueue(SelectCase& c);
+    // 节点可能已被唤醒方取出, 仍需加锁: 返回之后不再有其他线程访问它
+    void dequeue(SelectCase& c);
+
+    friend int Select(SelectCase* cases, size_t count, bool block);
+
+private:
+    std::atomic<bool> m_closed = {false};
+    // 保护等待队列
+    std::mutex m_mutex;
+    WaitQueue m_senders;
+    WaitQueue m_receivers;
+};
+
+template<class T>
+class Channel : public ChannelBase
+{
+public:
+    explicit Channel(size_t capacity = 1)
+        : m_capacity(capacity ? capacity : 1)
+        , m_cells(new Cell[m_capacity])
+    {
+        for(size_t i = 0; i < m_capacity; i++)
+        {
+            m_cells[i].seq.store(2 * i, std::memory_order_relaxed);
+        }
+    }
+
+    ~Channel()
+    {
+        // 析构剩余的数据
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        while(m_cells[pos % m_capacity].seq.load(std::memory_order_relaxed) == 2 * pos + 1)
+        {
+            m_cells[pos % m_capacity].item()->~T();
+            pos++;
+        }
+    }
+
+    // 满了或已关闭返回false, 失败时不移走value
+    bool trySend(const T& value) {return trySendImpl(value);}
+    bool trySend(T&& value) {return trySendImpl(std::move(value));}
+
+    // 空了返回false
+    bool tryRecv(T& out)
+    {
+        if(!pop(out))
+        {
+            return false;
+        }
+        notify(true);
+        return true;
+    }
+
+    // 满了挂起等待, 已关闭返回false
+    bool send(T value)
+    {
+        if(trySend(std::move(value)))
+        {
+            return true;
+        }
+        SelectCase c = sendCase(value);
+        return Select(&c, 1) == 0;
+    }
+
+    // 空了挂起等待, 已关闭且取完返回false
+    bool recv(T& out)
+    {
+        if(tryRecv(out))
+        {
+            return true;
+        }
+        SelectCase c = recvCase(out);
+        return Select(&c, 1) == 0;
+    }
+
+    // Select的分支, value/out在Select返回前必须有效
+    // value/out只由Select所在的协程在运行时访问, 此时它的共享栈已恢复到原地址 -> 可以放在共享栈上
+    SelectCase sendCase(T& value)
+    {
+        SelectCase c;
+        c.channel = this;
+        c.send = true;
+        c.tryOp = &TrySendCase;
+        c.item = &value;
+        return c;
+    }
+
+    SelectCase recvCase(T& out)
+    {
+        SelectCase c;
+        c.channel = this;
+        c.send = false;
+        c.tryOp = &TryRecvCase;
+        c.item = &out;
+        return c;
+    }
+
+    size_t capacity() const {return m_capacity;}
+    // 并发修改时只是近似值
+    size_t size() const
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+private:
+    // 槽位的序号: 等于2*pos时可写入第pos个数据, 等于2*pos+1时可读出
+    // 乘2是为了容量为1时"可读出第pos个"和"可写入第pos+1个"不混淆
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* item() {return std::launder(reinterpret_cast<T*>(storage));}
+    };
+
+    template<class U>
+    bool trySendImpl(U&& value)
+    {
+        if(isClosed())
+        {
+            return false;
+        }
+        if(!push(std::forward<U>(value)))
+        {
+            return false;
+        }
+        notify(false);
+        return true;
+    }
+
+    template<class U>
+    bool push(U&& value)
+    {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        while(true)
+        {
+            Cell& cell = m_cells[pos % m_capacity];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(2 * pos);
+            if(diff == 0)
+            {
+                // 抢到槽位后才构造 -> 失败时不移走value
+                if(m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    new (cell.storage) T(std::forward<U>(value));
+                    cell.seq.store(2 * pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0)
+            {
+                // 满了
+                return false;
+            }
+            else
+            {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(T& out)
+    {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        while(true)
+        {
+            Cell& cell = m_cells[pos % m_capacity];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(2 * pos + 1);
+            if(diff == 0)
+            {
+                if(m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    out = std::move(*cell.item());
+                    cell.item()->~T();
+                    // 一圈之后再写入这个槽位
+                    cell.seq.store(2 * (pos + m_capacity), std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0)
+            {
+                // 空了
+                return false;
+            }
+            else
+            {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    static bool TrySendCase(SelectCase& c)
+    {
+        return static_cast<Channel*>(c.channel)->trySend(std::move(*static_cast<T*>(c.item)));
+    }
+
+    static bool TryRecvCase(SelectCase& c)
+    {
+        return static_cast<Channel*>(c.channel)->tryRecv(*static_cast<T*>(c.item));
+    }
+
+private:
+    const size_t m_capacity;
+    std::unique_ptr<Cell[]> m_cells;
+    // 生产者和消费者的位置分开在不同缓存行上
+    alignas(64) std::atomic<size_t> m_tail = {0};
+    alignas(64) std::atomic<size_t> m_head = {0};
+};
+
+}
+
+#endif
@@ -0,0 +1,147 @@
+#include "context_ly.h"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <pthread.h>
+
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+
+// void sylar_context_swap(void** from_sp, void* to_sp)
+// 只保存callee-saved寄存器, 不像swapcontext那样保存信号掩码(rt_sigprocmask系统调用)和整个ucontext_t
+extern "C" void sylar_context_swap(void** from_sp, void* to_sp);
+
+#if defined(__x86_64__)
+// 栈布局(从sp往高地址): mxcsr/x87控制字 r15 r14 r13 r12 rbx rbp 返回地址
+asm(
+    ".text\n"
+    ".globl sylar_context_swap\n"
+    ".hidden sylar_context_swap\n"
+    ".type sylar_context_swap,@function\n"
+    ".align 16\n"
+    "sylar_context_swap:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size sylar_context_swap,.-sylar_context_swap\n"
+);
+#elif defined(__aarch64__)
+// 栈布局(从sp往高地址): x19-x28 x29(fp) x30(lr) d8-d15
+asm(
+    ".text\n"
+    ".globl sylar_context_swap\n"
+    ".hidden sylar_context_swap\n"
+    ".type sylar_context_swap,%function\n"
+    ".align 4\n"
+    "sylar_context_swap:\n"
+    "    sub sp, sp, #160\n"
+    "    stp x19, x20, [sp, #0]\n"
+    "    stp x21, x22, [sp, #16]\n"
+    "    stp x23, x24, [sp, #32]\n"
+    "    stp x25, x26, [sp, #48]\n"
+    "    stp x27, x28, [sp, #64]\n"
+    "    stp x29, x30, [sp, #80]\n"
+    "    stp d8, d9, [sp, #96]\n"
+    "    stp d10, d11, [sp, #112]\n"
+    "    stp d12, d13, [sp, #128]\n"
+    "    stp d14, d15, [sp, #144]\n"
+    "    mov x9, sp\n"
+    "    str x9, [x0]\n"
+    "    mov sp, x1\n"
+    "    ldp x19, x20, [sp, #0]\n"
+    "    ldp x21, x22, [sp, #16]\n"
+    "    ldp x23, x24, [sp, #32]\n"
+    "    ldp x25, x26, [sp, #48]\n"
+    "    ldp x27, x28, [sp, #64]\n"
+    "    ldp x29, x30, [sp, #80]\n"
+    "    ldp d8, d9, [sp, #96]\n"
+    "    ldp d10, d11, [sp, #112]\n"
+    "    ldp d12, d13, [sp, #128]\n"
+    "    ldp d14, d15, [sp, #144]\n"
+    "    add sp, sp, #160\n"
+    "    ret\n"
+    ".size sylar_context_swap,.-sylar_context_swap\n"
+);
+#endif
+
+#endif // SYLAR_FIBER_ASM_CONTEXT
+
+namespace sylar {
+
+const char* context_backend()
+{
+#if defined(SYLAR_FIBER_ASM_CONTEXT) && defined(__x86_64__)
+    return "asm-x86_64";
+#elif defined(SYLAR_FIBER_ASM_CONTEXT) && defined(__aarch64__)
+    return "asm-aarch64";
+#else
+    return "ucontext";
+#endif
+}
+
+void context_make(Context* ctx, void* stack, size_t size, void (*fn)())
+{
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+    // 栈顶16字节对齐
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+
+#if defined(__x86_64__)
+    // 第一次切入时 ret 到fn, 此时 rsp = top - 8, 与正常call进入函数时的对齐一致
+    uint64_t* frame = (uint64_t*)(top - 72);
+    memset(frame, 0, 72);
+    uint32_t* fpu = (uint32_t*)frame;
+    fpu[0] = 0x1F80; // mxcsr 默认值
+    fpu[1] = 0x037F; // x87 控制字默认值
+    frame[7] = (uint64_t)fn; // 返回地址
+#else
+    // 第一次切入时 ret 跳到 x30, 此时 sp = top
+    uint64_t* frame = (uint64_t*)(top - 160);
+    memset(frame, 0, 160);
+    frame[11] = (uint64_t)fn; // x30
+#endif
+    ctx->sp = frame;
+#else
+    if(getcontext(&ctx->uc))
+    {
+        std::cerr << "context_make() getcontext failed\n";
+        pthread_exit(NULL);
+    }
+    ctx->uc.uc_link = nullptr;
+    ctx->uc.uc_stack.ss_sp = stack;
+    ctx->uc.uc_stack.ss_size = size;
+    makecontext(&ctx->uc, fn, 0);
+#endif
+}
+
+void context_swap(Context* from, Context* to)
+{
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+    sylar_context_swap(&from->sp, to->sp);
+#else
+    if(swapcontext(&from->uc, &to->uc))
+    {
+        std::cerr << "context_swap() swapcontext failed\n";
+        pthread_exit(NULL);
+    }
+#endif
+}
+
+}
@@ -0,0 +1,38 @@
+#ifndef _CONTEXT_LY_H_
+#define _CONTEXT_LY_H_
+
+#include <cstddef>
+
+// 上下文切换后端选择:
+// 默认在 x86-64 / aarch64 上使用手写汇编切换, 只保存callee-saved寄存器和栈指针
+// 编译时加 -DSYLAR_FIBER_UCONTEXT 可退回到 ucontext (getcontext/makecontext/swapcontext)
+#if !defined(SYLAR_FIBER_UCONTEXT) && (defined(__x86_64__) || defined(__aarch64__))
+#define SYLAR_FIBER_ASM_CONTEXT 1
+#else
+#include <ucontext.h>
+#endif
+
+namespace sylar {
+
+struct Context
+{
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+    // 挂起时的栈顶, 寄存器保存在栈上
+    void* sp = nullptr;
+#else
+    ucontext_t uc;
+#endif
+};
+
+// 当前编译使用的后端名称
+const char* context_backend();
+
+// 在[stack, stack + size)上构造初始上下文, 第一次切入时执行fn (fn不能返回)
+void context_make(Context* ctx, void* stack, size_t size, void (*fn)());
+
+// 保存当前上下文到from, 切换到to
+void context_swap(Context* from, Context* to);
+
+}
+
+#endif
@@ -4,6 +4,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <thread>
 
 namespace sylar{
 
@@ -13,13 +14,23 @@ template class Singleton<FdManager>;// FdManager 类有一个全局唯一的单
 // Static variables need to be defined outside the class
 // 这些行代码定义了 singleton 类模板的静态成员变量 instance 和 mutex。静态成员变量需要在类外部定义和初始化。
 template<typename T>
-T* Singleton<T>::instance = nullptr; // 静态实例指针初始化为 nullptr
+std::atomic<T*> Singleton<T>::instance{nullptr}; // 静态实例指针初始化为 nullptr
 template<typename T>
 std::mutex Singleton<T>::mutex; // 静态互斥锁初始化
 
 FdCtx::FdCtx(int fd) : m_fd(fd)
 {
-    init(); // 
+}
+
+void FdCtx::reset()
+{
+    m_isInit = false;
+    m_isSocket = false;
+    m_sysNonblock = false;
+    m_userNonblock = false;
+    m_isClosed = false;
+    m_recvTimeout = (uint64_t)-1;
+    m_sendTimeout = (uint64_t)-1;
 }
 
 FdCtx::~FdCtx()
@@ -95,54 +106,59 @@ uint64_t FdCtx::getTimeout(int type)
 
 FdManager::FdManager()
 {
-    m_datas.resize(64); // 初始化文件描述符上下文数组，大小为 64
 }
 
-std::shared_ptr<FdCtx> FdManager::get(int fd, bool auto_create)
+FdCtx* FdManager::get(int fd, bool auto_create)
 {
-    if(fd < 0) // if(fd==-1)
+    // 不创建 -> 不分配块
+    FdCtx* ctx = auto_create ? m_datas.get(fd) : m_datas.find(fd);
+    if(!ctx)
     {
         return nullptr; // 如果文件描述符无效，返回空指针
     }
 
-    std::shared_lock<std::shared_mutex> read_lock(m_mutex); // 共享锁，允许多个线程同时读取
-    if(m_datas.size() <= fd) // 如果文件描述符超过当前数组大小
+    while(true)
     {
-        if(auto_create == false) // 如果不允许自动创建
+        int state = ctx->m_state.load(std::memory_order_acquire);
+        if(state == FdCtx::USED)
         {
-            return nullptr; // 返回空指针
+            return ctx; // 返回已存在的文件描述符上下文
         }
-    }
-    else
-    {
-        if(m_datas[fd] || !auto_create) // 如果文件描述符上下文已存在或不允许自动创建
+        if(!auto_create)
+        {
+            return nullptr;
+        }
+
+        // 第一个创建者负责初始化
+        if(state == FdCtx::FREE && ctx->m_state.compare_exchange_strong(state, FdCtx::INITING, std::memory_order_acquire))
         {
-            return m_datas[fd]; // 返回已存在的文件描述符上下文，初始化为nullptr
+            ctx->reset();
+            ctx->init();
+            ctx->m_generation++;
+            ctx->m_state.store(FdCtx::USED, std::memory_order_release);
+            return ctx;
         }
+        // 其他线程正在初始化 -> 等它完成
+        std::this_thread::yield();
     }
+}
 
-    read_lock.unlock(); // 释放共享锁
-    std::unique_lock<std::shared_mutex> write_lock(m_mutex); // 独占锁，允许一个线程写入
-    if(m_datas.size() <= fd) // 如果文件描述符超过当前数组大小
+void FdManager::del(int fd)
+{
+    FdCtx* ctx = m_datas.find(fd);
+    if(!ctx)
     {
-        m_datas.resize(fd * 1.5); // 扩展数组大小
+        return;
     }
-
-    m_datas[fd] = std::make_shared<FdCtx>(fd); // 创建新的文件描述符上下文并存储在数组中
-    return m_datas[fd]; // 返回新创建的文件描述符上下文
-
+    int state = FdCtx::USED;
+    ctx->m_state.compare_exchange_strong(state, FdCtx::FREE, std::memory_order_release);
 }
 
-void FdManager::del(int fd)
+FdCtx* FdManager::renew(int fd)
 {
-	std::unique_lock<std::shared_mutex> write_lock(m_mutex);
-	if(m_datas.size() <= fd)
-	{
-		return;
-	}
-	m_datas[fd].reset();
+    del(fd);
+    return get(fd, true);
 }
 
 
 }
-
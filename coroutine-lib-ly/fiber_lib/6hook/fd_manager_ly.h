@@ -1,37 +1,59 @@
 #ifndef _FD_MANAGER_LY_H_
 #define _FD_MANAGER_LY_H_
 
+#include <atomic>
 #include <memory>
-#include <shared_mutex>
 
 #include "thread_ly.h"
+#include "fd_table_ly.h"
 
 namespace sylar {
 
 // fd info
-class FdCtx : public std::enable_shared_from_this<FdCtx>
+// 存放在FdManager的表中, 一个fd号对应一个固定的FdCtx, 关闭后留给下一个同号的fd复用
+// 其他线程可能同时读写(如setsockopt与read) -> 字段都是原子变量
+class FdCtx
 {
 private:
-    bool m_isInit = false; //标记文件描述符是否已初始化。
-    bool m_isSocket = false;//标记文件描述符是否是一个套接字。
-    bool m_sysNonblock = false;//标记文件描述符是否设置为系统非阻塞模式。
-    bool m_userNonblock = false;//标记文件描述符是否设罱为用户非阳塞模式
-    bool m_isClosed = false;//标记文件描述符是否已关闭。
+    friend class FdManager;
+
+    // 槽位状态, 由FdManager维护
+    enum State
+    {
+        FREE,
+        // 正在初始化, 其他线程等待
+        INITING,
+        USED
+    };
+    std::atomic<int> m_state = {FREE};
+
+    std::atomic<bool> m_isInit = {false}; //标记文件描述符是否已初始化。
+    std::atomic<bool> m_isSocket = {false};//标记文件描述符是否是一个套接字。
+    std::atomic<bool> m_sysNonblock = {false};//标记文件描述符是否设置为系统非阻塞模式。
+    std::atomic<bool> m_userNonblock = {false};//标记文件描述符是否设罱为用户非阳塞模式
+    std::atomic<bool> m_isClosed = {false};//标记文件描述符是否已关闭。
     int m_fd;//文件描述符的整数值
+    // 槽位每次(重新)初始化加1 -> 区分先后使用同一个fd号的不同文件
+    std::atomic<uint32_t> m_generation = {0};
 
     // read event timeout
-    uint64_t m_recvTimeout = (uint64_t)-1;//读事件的超时时间，默认为 -1 表示没有超时限制
+    std::atomic<uint64_t> m_recvTimeout = {(uint64_t)-1};//读事件的超时时间(微秒)，默认为 -1 表示没有超时限制
     // write event timeout
-    uint64_t m_sendTimeout = (uint64_t)-1;//写事件的超时时间，默认为 -1 表示没有超时限制
+    std::atomic<uint64_t> m_sendTimeout = {(uint64_t)-1};//写事件的超时时间(微秒)，默认为 -1 表示没有超时限制
+
+    // 恢复为未初始化的状态
+    void reset();
 
 public:
-    FdCtx(int fd);
+    // 只记录fd, 由FdManager在fd第一次使用时调用init()
+    explicit FdCtx(int fd);
     ~FdCtx();
 
     bool init(); // 初始化 Fdctx 对象。初始化文件描述符上下文
     bool isInit() const { return m_isInit; } //检查文件描述符是否已初始化
     bool isSocket() const { return m_isSocket; } //检查文件描述符是否是套接字
     bool isClosed() const { return m_isClosed; } //检查文件描述符是否已关闭
+    uint32_t getGeneration() const { return m_generation; }
 
     //设置和获取用户层面的非阻塞状态。
     void setUserNonblock(bool v) { m_userNonblock = v; } //设置用户非阻塞模式
@@ -41,7 +63,7 @@ public:
     void setSysNonblock(bool v) { m_sysNonblock = v; } //设置系统非阻塞模式
     bool getSysNonblock() const { return m_sysNonblock; } //获取系统非阻塞模式状态
 
-    //设置和获取超时时间，type 用于区分读事件和写事件的超时设置，v表示时间毫秒。
+    //设置和获取超时时间，type 用于区分读事件和写事件的超时设置，v表示时间微秒(与timeval精度一致)。
     void setTimeout(int type, uint64_t v); //设置超时时间
     uint64_t getTimeout(int type); //获取超时时间
 };
@@ -54,13 +76,15 @@ public:
     // 获取文件描述符上下文。
     // 如果 auto create 为 true，在不存在时自动创建新的 Fdctx 对象。
     // 如果不存在则根据 auto_create 参数决定是否创建新的上下文。
-    std::shared_ptr<FdCtx> get(int fd, bool auto_create = false);
+    // 无锁; 返回的指针一直有效, fd关闭后会被同号的新fd复用
+    FdCtx* get(int fd, bool auto_create = false);
     void del(int fd); //删除指定文件描述符的 Fdctx 对象, 删除指定的文件描述符上下文
+    // fd刚由socket/accept创建: 同号的旧fd可能没有经过hook的close关闭(关闭了hook或直接syscall), 槽位仍是旧的 -> 重新初始化
+    FdCtx* renew(int fd);
 
 private:
-    std::shared_mutex m_mutex;
-    // 若通过构造函数指定初始大小（如 vector<n>）：​​std::shared_ptr 元素​​：每个元素会被值初始化，即 nullptr。
-    std::vector<std::shared_ptr<FdCtx>> m_datas;
+    // 按fd范围分块分配, 查找只需一次原子读
+    FdTable<FdCtx> m_datas;
 };
 
 // 单例模式
@@ -68,7 +92,7 @@ template<typename T>
 class Singleton
 {
 private:
-    static T* instance; // 静态实例指针
+    static std::atomic<T*> instance; // 静态实例指针
     static std::mutex mutex; // 互斥锁
 
 protected:
@@ -80,14 +104,29 @@ public:
     Singleton& operator=(const Singleton&) = delete; // 禁止赋值操作
 
     // 获取单例实例
+    // 已创建 -> 只需一次acquire读, 只有第一次创建时加锁
     static T* GetInstance()
     {
+        T* p = instance.load(std::memory_order_acquire);
+        if(p)
+        {
+            return p;
+        }
+
         std::lock_guard<std::mutex> lock(mutex);
-        if(instance == nullptr)
+        p = instance.load(std::memory_order_relaxed);
+        if(p == nullptr)
         {
-            instance = new T();
+            p = new T();
+            instance.store(p, std::memory_order_release);
         }
-        return instance;
+        return p;
+    }
+
+    // 已创建时返回实例, 否则返回nullptr, 不会创建
+    static T* FindInstance()
+    {
+        return instance.load(std::memory_order_acquire);
     }
 
     // 销毁单例实例
@@ -95,8 +134,7 @@ public:
     {
         std::lock_guard<std::mutex> lock(mutex);
         // delete一个nullptr是完全安全的操作，不会引发任何错误或异常。这是由C++标准明确规定的行为
-        delete instance;
-        instance = nullptr;
+        delete instance.exchange(nullptr);
     }
 };
 
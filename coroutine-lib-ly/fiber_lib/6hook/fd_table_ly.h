@@ -0,0 +1,103 @@
+#ifndef _FD_TABLE_LY_H_
+#define _FD_TABLE_LY_H_
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+namespace sylar {
+
+// fd -> T 的两级表, 只增不减, 查找无锁
+// 第一级是固定大小的块指针数组, 第二级是定长块, 第一次访问到某个fd范围时才分配并用CAS发布
+// 块一旦发布就不会移动或释放 -> 返回的指针在表析构前一直有效
+// T需要有以fd为参数的构造函数
+template <class T, int CHUNK_BITS = 8, int MAX_FD_BITS = 20>
+class FdTable
+{
+public:
+    static const int CHUNK_SIZE = 1 << CHUNK_BITS;
+    static const int MAX_FD = 1 << MAX_FD_BITS;
+
+    FdTable() : m_chunks(new std::atomic<T*>[MAX_FD >> CHUNK_BITS]())
+    {
+    }
+
+    ~FdTable()
+    {
+        for(int i = 0; i < (MAX_FD >> CHUNK_BITS); i++)
+        {
+            T* chunk = m_chunks[i].load(std::memory_order_relaxed);
+            if(chunk)
+            {
+                DeleteChunk(chunk);
+            }
+        }
+        delete[] m_chunks;
+    }
+
+    FdTable(const FdTable&) = delete;
+    FdTable& operator=(const FdTable&) = delete;
+
+    // 所在块还未分配时返回nullptr
+    T* find(int fd) const
+    {
+        if(fd < 0 || fd >= MAX_FD)
+        {
+            return nullptr;
+        }
+        T* chunk = m_chunks[fd >> CHUNK_BITS].load(std::memory_order_acquire);
+        return chunk ? &chunk[fd & (CHUNK_SIZE - 1)] : nullptr;
+    }
+
+    // 所在块还未分配时分配, fd超出范围返回nullptr
+    T* get(int fd)
+    {
+        if(fd < 0 || fd >= MAX_FD)
+        {
+            return nullptr;
+        }
+        std::atomic<T*>& slot = m_chunks[fd >> CHUNK_BITS];
+        T* chunk = slot.load(std::memory_order_acquire);
+        if(!chunk)
+        {
+            T* fresh = NewChunk(fd & ~(CHUNK_SIZE - 1));
+            // 其他线程先发布了 -> 用它的, 释放自己的
+            if(slot.compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                chunk = fresh;
+            }
+            else
+            {
+                DeleteChunk(fresh);
+            }
+        }
+        return &chunk[fd & (CHUNK_SIZE - 1)];
+    }
+
+private:
+    static T* NewChunk(int base)
+    {
+        T* chunk = static_cast<T*>(::operator new(sizeof(T) * CHUNK_SIZE));
+        for(int i = 0; i < CHUNK_SIZE; i++)
+        {
+            new (&chunk[i]) T(base + i);
+        }
+        return chunk;
+    }
+
+    static void DeleteChunk(T* chunk)
+    {
+        for(int i = 0; i < CHUNK_SIZE; i++)
+        {
+            chunk[i].~T();
+        }
+        ::operator delete(chunk);
+    }
+
+private:
+    std::atomic<T*>* m_chunks;
+};
+
+}
+
+#endif
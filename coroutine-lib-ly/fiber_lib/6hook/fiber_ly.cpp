@@ -1,4 +1,10 @@
 #include "fiber_ly.h"
+#include "stack_profiler_ly.h"
+
+#include <cstring>
+#include <vector>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 static bool debug = false;
 
@@ -16,6 +22,60 @@ static std::atomic<uint64_t> s_fiber_id{0};
 // 协程计数器
 static std::atomic<uint64_t> s_fiber_count{0};
 
+// 当前线程id, 用于绑定共享栈协程
+static thread_local int t_thread_id = syscall(SYS_gettid);
+
+// 共享栈配置
+static std::atomic<size_t> s_shared_stack_count{4};
+static std::atomic<size_t> s_shared_stack_size{1024 * 1024};
+
+// 共享栈: 同一时刻只有occupant的栈内容在上面
+struct SharedStack
+{
+    void* stack = nullptr;
+    size_t size = 0;
+    StackAllocator::Backend backend;
+    // 保护occupant, 协程可能在其他线程析构
+    std::mutex mutex;
+    Fiber* occupant = nullptr;
+
+    SharedStack(size_t stack_size): size(stack_size)
+    {
+        backend = StackAllocator::GetDefaultBackend();
+        stack = StackAllocator::Alloc(size, backend);
+    }
+
+    ~SharedStack()
+    {
+        StackAllocator::Dealloc(stack, size, backend);
+    }
+
+    char* top() const {return (char*)stack + size;}
+};
+
+// 每个线程的共享栈, 轮流分配给新的共享栈协程
+// 协程持有shared_ptr, 线程退出后共享栈在最后一个协程析构时释放
+struct SharedStackPool
+{
+    std::vector<std::shared_ptr<SharedStack>> stacks;
+    size_t next = 0;
+
+    std::shared_ptr<SharedStack> get()
+    {
+        if(stacks.empty())
+        {
+            size_t count = std::max<size_t>(s_shared_stack_count, 1);
+            for(size_t i = 0; i < count; i++)
+            {
+                stacks.push_back(std::make_shared<SharedStack>(s_shared_stack_size));
+            }
+        }
+        return stacks[next++ % stacks.size()];
+    }
+};
+
+static thread_local SharedStackPool t_shared_stacks;
+
 // 设置当前运行的协程
 void Fiber::SetThis(Fiber *f)
 {
@@ -55,10 +115,7 @@ Fiber::Fiber()
     SetThis(this);
     m_state = RUNNING;
 
-    if(getcontext(&m_ctx)){
-        std::cerr << "Fiber() failed\n";
-        pthread_exit(NULL);
-    }
+    // 主协程的上下文在第一次切出时由context_swap保存
 
     m_id = s_fiber_id++;
     s_fiber_count++;
@@ -66,23 +123,33 @@ Fiber::Fiber()
     if(debug) std::cout << "Fiber(): main id = " << m_id << std::endl;
 }
 
-Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler):  
+Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler, bool shared_stack):  
 m_cb(cb), m_runInScheduler(run_in_scheduler)
 {
     m_state = READY;
-    // 分配协程栈空间
-    m_stacksize = stacksize ? stacksize : 128000; //12.5KB
-    m_stack = malloc(m_stacksize);
-    //
-    if(getcontext(&m_ctx)){
-        std::cerr << "Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler) failed\n";
-		pthread_exit(NULL);
-    }
-    //
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+    // 共享栈 -> 第一次resume时再分配共享栈和构造上下文
+    if(shared_stack)
+    {
+        m_useSharedStack = true;
+    }
+#else
+    // ucontext实现不支持共享栈, 仍使用独立栈
+    (void)shared_stack;
+#endif
+    if(!m_useSharedStack)
+    {
+        // 分配协程栈空间
+        m_stacksize = stacksize ? stacksize : DEFAULT_STACK_SIZE; //125KB
+        m_stackBackend = StackAllocator::GetDefaultBackend();
+        m_stack = StackAllocator::Alloc(m_stacksize, m_stackBackend);
+        if(StackProfiler::IsEnabled())
+        {
+            paintStack();
+        }
+        //
+        context_make(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc);
+    }
 
     m_id = s_fiber_id++;
     s_fiber_count++;
@@ -95,27 +162,42 @@ Fiber::~Fiber()
     s_fiber_count--;
     if(m_stack)
     {
-        free(m_stack);
+        StackAllocator::Dealloc(m_stack, m_stacksize, m_stackBackend);
     }
+    if(m_sharedStack)
+    {
+        std::lock_guard<std::mutex> lock(m_sharedStack->mutex);
+        if(m_sharedStack->occupant == this)
+        {
+            m_sharedStack->occupant = nullptr;
+        }
+    }
+    free(m_saveBuffer);
     if(debug) std::cout << "~Fiber(): id = " << m_id << std::endl;	
 }
 
 void Fiber::reset(std::function<void()> cb)
 {
-    assert(m_stack != nullptr && m_state == TERM);
+    assert((m_stack != nullptr || m_useSharedStack) && m_state == TERM);
 
     m_state = READY;
     m_cb = cb;
 
-    if(getcontext(&m_ctx)){
-        std::cerr << "reset() failed\n";
-		pthread_exit(NULL);
+    if(m_useSharedStack)
+    {
+        // 下次resume时重新构造上下文
+        m_ctx = Context();
+        return;
     }
-
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
+    if(StackProfiler::IsEnabled())
+    {
+        paintStack();
+    }
+    else
+    {
+        m_stackPainted = false;
+    }
+    context_make(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc);
 }
 
 void Fiber::resume()
@@ -124,23 +206,27 @@ void Fiber::resume()
 
     m_state = RUNNING;
 
+    if(m_useSharedStack)
+    {
+        // 在调用方(调度协程或主协程)的栈上完成拷贝
+        switchInSharedStack();
+    }
+
     if(m_runInScheduler)
     {
         SetThis(this);
-        if(swapcontext(&(t_scheduler_fiber->m_ctx), &m_ctx))
-        {
-            std::cerr << "resume() to current coroutine from t_scheduler_fiber failed\n";
-            pthread_exit(NULL);
-        }
+        context_swap(&(t_scheduler_fiber->m_ctx), &m_ctx);
     }
     else
     {
         SetThis(this);
-        if(swapcontext(&(t_thread_fiber->m_ctx), &m_ctx))
-        {
-            std::cerr << "resume() to current coroutine from t_thread_fiber failed\n";
-            pthread_exit(NULL);
-        }
+        context_swap(&(t_thread_fiber->m_ctx), &m_ctx);
+    }
+
+    // 协程结束 -> 测量栈的最高水位
+    if(m_state == TERM && m_stackPainted)
+    {
+        measureStack();
     }
 }
 
@@ -156,20 +242,12 @@ void Fiber::yield()
     if(m_runInScheduler)
     {
         SetThis(t_scheduler_fiber);
-        if(swapcontext(&m_ctx, &(t_scheduler_fiber->m_ctx)))
-        {
-            std::cerr << "yield() to to t_scheduler_fiber failed\n";
-            pthread_exit(NULL);
-        }
+        context_swap(&m_ctx, &(t_scheduler_fiber->m_ctx));
     }
     else
     {
         SetThis(t_thread_fiber.get());
-        if(swapcontext(&m_ctx, &(t_thread_fiber->m_ctx)))
-        {
-            std::cerr << "yield() to to t_thread_fiber failed\n";
-            pthread_exit(NULL);
-        }
+        context_swap(&m_ctx, &(t_thread_fiber->m_ctx));
     }
 }
 
@@ -189,6 +267,89 @@ void Fiber::MainFunc()
     raw_ptr->yield();
 }
 
+void Fiber::SetSharedStackConfig(size_t count, size_t size)
+{
+    s_shared_stack_count = count;
+    s_shared_stack_size = size;
+}
+
+void Fiber::switchInSharedStack()
+{
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+    if(!m_sharedStack)
+    {
+        m_sharedStack = t_shared_stacks.get();
+        m_boundThread = t_thread_id;
+    }
+    // 栈内容中的指针只在该共享栈的地址上有效 -> 只能在绑定的线程上运行
+    assert(m_boundThread == t_thread_id);
+    assert(t_fiber == nullptr || !t_fiber->m_useSharedStack);
+
+    SharedStack* ss = m_sharedStack.get();
+    std::lock_guard<std::mutex> lock(ss->mutex);
+
+    bool fresh = (m_ctx.sp == nullptr);
+    if(ss->occupant != this)
+    {
+        // 换出当前占用者
+        if(ss->occupant)
+        {
+            ss->occupant->saveSharedStack();
+        }
+        ss->occupant = this;
+        // 恢复自己的栈内容
+        if(!fresh)
+        {
+            memcpy(ss->top() - m_saveSize, m_saveBuffer, m_saveSize);
+        }
+    }
+    if(fresh)
+    {
+        context_make(&m_ctx, ss->stack, ss->size, &Fiber::MainFunc);
+    }
+#endif
+}
+
+void Fiber::saveSharedStack()
+{
+#ifdef SYLAR_FIBER_ASM_CONTEXT
+    // 已结束或尚未运行 -> 没有需要保存的内容
+    if(m_state == TERM || m_ctx.sp == nullptr)
+    {
+        return;
+    }
+
+    // 只拷贝已用部分 [sp, top), 缓冲区按实际大小分配
+    size_t used = m_sharedStack->top() - (char*)m_ctx.sp;
+    if(used != m_saveSize)
+    {
+        m_saveBuffer = (char*)realloc(m_saveBuffer, used);
+        m_saveSize = used;
+    }
+    memcpy(m_saveBuffer, m_ctx.sp, used);
+#endif
+}
+
+void Fiber::paintStack()
+{
+    // 复用时只需重新填充上次用到的部分
+    if(m_stackPainted)
+    {
+        StackProfiler::Paint((char*)m_stack + m_stacksize - m_stackUsed, m_stackUsed);
+    }
+    else
+    {
+        StackProfiler::Paint(m_stack, m_stacksize);
+        m_stackPainted = true;
+    }
+}
+
+void Fiber::measureStack()
+{
+    m_stackUsed = StackProfiler::Measure(m_stack, m_stacksize);
+    StackProfiler::Record(m_tag, m_stackUsed);
+}
+
 
 
 }
\ No newline at end of file
@@ -6,11 +6,16 @@
 #include <atomic>
 #include <mutex>
 #include <functional>
-#include <ucontext.h>
 #include <cassert>
 
+#include "context_ly.h"
+#include "stack_alloc_ly.h"
+
 namespace sylar {
 
+// 共享栈, 定义见fiber_ly.cpp
+struct SharedStack;
+
 class Fiber : public std::enable_shared_from_this<Fiber>
 {
 public:
@@ -23,12 +28,18 @@ public:
 
     std::mutex m_mutex;
 
+    // 默认栈大小
+    static constexpr uint32_t DEFAULT_STACK_SIZE = 128000;
+
 private:
     //
     Fiber();
 
 public:
-    Fiber(std::function<void()> cb, size_t stacksize = 0, bool run_in_scheduler = true);
+    // shared_stack = true -> 共享栈模式(仅汇编切换后端支持, 否则退回独立栈):
+    // 协程运行在所在线程的若干共享栈之一上, 被其他协程换出时才把已用部分拷贝到自己的保存缓冲区
+    // 共享栈协程第一次运行后绑定在该线程上
+    Fiber(std::function<void()> cb, size_t stacksize = 0, bool run_in_scheduler = true, bool shared_stack = false);
     ~Fiber();
 
     //
@@ -39,6 +50,18 @@ public:
 
     uint64_t getId() const {return m_id;}
     State getState() const {return m_state;}
+    uint32_t getStackSize() const {return m_stacksize;}
+    bool isRunInScheduler() const {return m_runInScheduler;}
+    bool isSharedStack() const {return m_useSharedStack;}
+    // 共享栈协程绑定的线程id, 未绑定返回-1
+    int getBoundThread() const {return m_boundThread;}
+    // 共享栈协程当前保存缓冲区的大小
+    size_t getSavedStackSize() const {return m_saveSize;}
+    // 栈使用统计的标签, 需指向静态存储
+    void setTag(const char* tag) {m_tag = tag;}
+    const char* getTag() const {return m_tag;}
+    // 上次结束时测得的栈最高水位(需开启StackProfiler)
+    size_t getStackUsed() const {return m_stackUsed;}
     //
     static void SetThis(Fiber *f);
     //
@@ -49,6 +72,17 @@ public:
     static uint64_t GetFiberId();
     //
     static void MainFunc();
+    // 设置每个线程的共享栈数量和大小, 对之后新建共享栈的线程生效
+    static void SetSharedStackConfig(size_t count, size_t size);
+
+private:
+    // 切入共享栈: 换出当前占用者的栈内容, 恢复自己的栈内容
+    void switchInSharedStack();
+    // 把已用的栈内容拷贝到保存缓冲区
+    void saveSharedStack();
+    // 栈使用统计: 填充哨兵值 / 结束时测量并记录
+    void paintStack();
+    void measureStack();
 
 private:
     // 
@@ -57,14 +91,33 @@ private:
     State m_state = READY;
     //
     uint32_t m_stacksize = 0;
-    // ucontext_t 
-    ucontext_t m_ctx;
-    //
+    // 协程上下文 (汇编切换或ucontext, 见context_ly.h)
+    Context m_ctx;
+    // 协程栈
     void* m_stack = nullptr;
+    // 协程栈的分配方式
+    StackAllocator::Backend m_stackBackend = StackAllocator::MALLOC;
     //
     std::function<void()> m_cb;
     //
-    bool m_runInScheduler;
+    bool m_runInScheduler = false;
+
+    // 是否使用共享栈
+    bool m_useSharedStack = false;
+    // 绑定的线程id
+    int m_boundThread = -1;
+    // 所在的共享栈, 第一次运行时分配
+    std::shared_ptr<SharedStack> m_sharedStack;
+    // 被换出时保存的栈内容
+    char* m_saveBuffer = nullptr;
+    size_t m_saveSize = 0;
+
+    // 栈使用统计的标签
+    const char* m_tag = nullptr;
+    // 栈是否已填充哨兵值
+    bool m_stackPainted = false;
+    // 上次测得的栈最高水位
+    size_t m_stackUsed = 0;
 
 
 
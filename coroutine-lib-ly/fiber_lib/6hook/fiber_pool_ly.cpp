@@ -0,0 +1,178 @@
+#include "fiber_pool_ly.h"
+
+static bool debug = false;
+
+namespace sylar {
+
+// 水位配置
+static std::atomic<size_t> s_high_watermark{64};
+static std::atomic<size_t> s_low_watermark{16};
+
+// 统计
+static std::atomic<uint64_t> s_hits{0};
+static std::atomic<uint64_t> s_global_hits{0};
+static std::atomic<uint64_t> s_misses{0};
+static std::atomic<uint64_t> s_releases{0};
+static std::atomic<uint64_t> s_drops{0};
+
+// 同一栈大小的空闲协程
+struct SizedFiberList
+{
+    uint32_t stacksize;
+    std::vector<std::shared_ptr<Fiber>> fibers;
+};
+
+// 按栈大小查找空闲链表, create = true时不存在则新建
+static std::vector<std::shared_ptr<Fiber>>* FindList(std::vector<SizedFiberList>& lists, uint32_t stacksize, bool create)
+{
+    for(auto& list : lists)
+    {
+        if(list.stacksize == stacksize)
+        {
+            return &list.fibers;
+        }
+    }
+    if(!create)
+    {
+        return nullptr;
+    }
+    lists.push_back(SizedFiberList{stacksize, {}});
+    return &lists.back().fibers;
+}
+
+// 全局溢出链表: 接收各线程超出高水位的协程, 以及线程退出时剩余的协程
+struct GlobalFiberList
+{
+    std::mutex mutex;
+    std::vector<SizedFiberList> lists;
+
+    // 转移到全局链表, 超出容量的直接释放
+    void push(uint32_t stacksize, std::vector<std::shared_ptr<Fiber>>& from, size_t keep)
+    {
+        size_t capacity = s_high_watermark * 4;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::shared_ptr<Fiber>>& fibers = *FindList(lists, stacksize, true);
+        while(from.size() > keep)
+        {
+            if(fibers.size() < capacity)
+            {
+                fibers.push_back(std::move(from.back()));
+            }
+            else
+            {
+                s_drops++;
+            }
+            from.pop_back();
+        }
+    }
+
+    // 批量取回到本地链表
+    size_t pop(uint32_t stacksize, std::vector<std::shared_ptr<Fiber>>& to, size_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::shared_ptr<Fiber>>* fibers = FindList(lists, stacksize, false);
+        size_t n = 0;
+        while(fibers && n < count && !fibers->empty())
+        {
+            to.push_back(std::move(fibers->back()));
+            fibers->pop_back();
+            n++;
+        }
+        return n;
+    }
+};
+
+// 不析构: 避免其他线程退出时访问已析构的全局对象
+static GlobalFiberList& GetGlobalList()
+{
+    static GlobalFiberList* s_list = new GlobalFiberList();
+    return *s_list;
+}
+
+// 线程本地空闲链表
+struct LocalFiberList
+{
+    std::vector<SizedFiberList> lists;
+
+    ~LocalFiberList()
+    {
+        // 线程退出 -> 剩余的协程交给其他线程复用
+        for(auto& list : lists)
+        {
+            GetGlobalList().push(list.stacksize, list.fibers, 0);
+        }
+    }
+};
+
+static thread_local LocalFiberList t_local_list;
+
+std::shared_ptr<Fiber> FiberPool::Acquire(std::function<void()> cb, size_t stacksize)
+{
+    uint32_t size = stacksize ? stacksize : Fiber::DEFAULT_STACK_SIZE;
+    std::vector<std::shared_ptr<Fiber>>& local = *FindList(t_local_list.lists, size, true);
+
+    if(!local.empty())
+    {
+        s_hits++;
+    }
+    else if(GetGlobalList().pop(size, local, std::max<size_t>(s_low_watermark, 1)) > 0)
+    {
+        s_global_hits++;
+    }
+    else
+    {
+        s_misses++;
+        return std::make_shared<Fiber>(cb, size);
+    }
+
+    std::shared_ptr<Fiber> fiber = std::move(local.back());
+    local.pop_back();
+    fiber->reset(cb);
+    return fiber;
+}
+
+bool FiberPool::Release(std::shared_ptr<Fiber>& fiber)
+{
+    // 仍被其他地方引用(如定时器回调中捕获)的协程不能复用
+    if(!fiber || fiber.use_count() != 1 || fiber->getState() != Fiber::TERM)
+    {
+        return false;
+    }
+    if(fiber->isSharedStack() || !fiber->isRunInScheduler())
+    {
+        return false;
+    }
+
+    uint32_t size = fiber->getStackSize();
+    std::vector<std::shared_ptr<Fiber>>& local = *FindList(t_local_list.lists, size, true);
+    local.push_back(std::move(fiber));
+    s_releases++;
+
+    // 超过高水位 -> 转移到全局链表直到低水位
+    if(local.size() > s_high_watermark)
+    {
+        if(debug) std::cout << "FiberPool overflow, stacksize = " << size << ", local size = " << local.size() << std::endl;
+        GetGlobalList().push(size, local, s_low_watermark);
+    }
+    return true;
+}
+
+void FiberPool::SetWatermarks(size_t high, size_t low)
+{
+    assert(low <= high);
+    s_high_watermark = high;
+    s_low_watermark = low;
+}
+
+FiberPool::Stats FiberPool::GetStats()
+{
+    Stats stats;
+    stats.hits = s_hits;
+    stats.globalHits = s_global_hits;
+    stats.misses = s_misses;
+    stats.releases = s_releases;
+    stats.drops = s_drops;
+    return stats;
+}
+
+}
@@ -0,0 +1,47 @@
+#ifndef _FIBER_POOL_LY_H_
+#define _FIBER_POOL_LY_H_
+
+#include "fiber_ly.h"
+
+#include <vector>
+
+namespace sylar {
+
+// 回调任务协程池
+// 每个线程维护一个本地空闲链表, 已结束(TERM)的协程通过Fiber::reset()复用, 避免每个任务一次128KB的malloc/free
+// 本地链表超过高水位时, 多余的协程转移到全局溢出链表, 直到回落到低水位
+// 本地链表为空时先从全局链表批量取回, 都没有才新建协程
+class FiberPool
+{
+public:
+    struct Stats
+    {
+        // 从本地链表取到
+        uint64_t hits = 0;
+        // 从全局溢出链表取到
+        uint64_t globalHits = 0;
+        // 新建协程
+        uint64_t misses = 0;
+        // 回收成功
+        uint64_t releases = 0;
+        // 全局链表已满, 直接释放
+        uint64_t drops = 0;
+    };
+
+public:
+    // 取一个栈大小为stacksize(0为默认大小)的空闲协程并设置回调, 没有则新建
+    static std::shared_ptr<Fiber> Acquire(std::function<void()> cb, size_t stacksize = 0);
+
+    // 归还协程, 只接受已结束、无其他引用、独立栈且在调度器中运行的协程
+    // 按栈大小分别缓存, 成功后fiber被置空
+    static bool Release(std::shared_ptr<Fiber>& fiber);
+
+    // 设置每种栈大小的本地链表的高/低水位, 全局链表容量为高水位的4倍
+    static void SetWatermarks(size_t high, size_t low);
+
+    static Stats GetStats();
+};
+
+}
+
+#endif
@@ -0,0 +1,380 @@
+#include "fiber_sync_ly.h"
+#include "scheduler_ly.h"
+
+namespace sylar {
+
+// 挂起前的自旋次数
+static const int SPIN_COUNT = 64;
+
+static inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// 自旋等待try_acquire成功
+template<class TryAcquire>
+static bool Spin(TryAcquire try_acquire)
+{
+    for(int i = 0; i < SPIN_COUNT; i++)
+    {
+        if(try_acquire())
+        {
+            return true;
+        }
+        CpuRelax();
+    }
+    return false;
+}
+
+void FiberWaiter::prepare(Semaphore* thread_sem)
+{
+    std::shared_ptr<Fiber> cur = Fiber::GetThis();
+    if(Scheduler::GetThis() && cur->isRunInScheduler())
+    {
+        fiber = std::move(cur);
+        scheduler = Scheduler::GetThis();
+    }
+    else
+    {
+        sem = thread_sem;
+    }
+}
+
+void FiberWaiter::wait()
+{
+    if(fiber)
+    {
+        Fiber::GetThis()->yield();
+    }
+    else
+    {
+        sem->wait();
+    }
+}
+
+void FiberWaiter::wake()
+{
+    if(fiber)
+    {
+        // 协程还没挂起 -> 恢复它的线程会等到它yield之后
+        scheduler->scheduleLock(fiber);
+    }
+    else
+    {
+        sem->signal();
+    }
+}
+
+// 等待者先计数再重试, 释放者先释放再读计数 -> 两者至少有一方看到对方, 不会漏掉唤醒
+
+bool FiberMutex::try_lock()
+{
+    bool locked = false;
+    return m_locked.compare_exchange_strong(locked, true);
+}
+
+void FiberMutex::lock()
+{
+    Semaphore sem;
+    bool woken = false;
+    while(true)
+    {
+        // 被唤醒的等待者开始竞争 -> 之后的unlock()可以再唤醒下一个
+        if(woken)
+        {
+            m_wakeup = false;
+        }
+
+        if(Spin([this](){ return try_lock(); }))
+        {
+            return;
+        }
+
+        FiberWaiter waiter;
+        waiter.prepare(&sem);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_waiting++;
+            if(try_lock())
+            {
+                m_waiting--;
+                return;
+            }
+            m_waiters.push_back(waiter);
+        }
+        // 被唤醒后重新竞争, 不直接把锁交给它: 否则它被调度运行之前其他协程都拿不到锁, 会排成长队
+        waiter.wait();
+        woken = true;
+    }
+}
+
+void FiberMutex::unlock()
+{
+    m_locked = false;
+    // 已唤醒的等待者还没开始竞争 -> 不再唤醒
+    if(m_waiting == 0 || m_wakeup.exchange(true))
+    {
+        return;
+    }
+
+    FiberWaiter waiter;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_waiters.empty())
+        {
+            m_wakeup = false;
+            return;
+        }
+        waiter = std::move(m_waiters.front());
+        m_waiters.pop_front();
+        m_waiting--;
+    }
+    waiter.wake();
+}
+
+void FiberConditionVariable::wait(std::unique_lock<FiberMutex>& lock)
+{
+    Semaphore sem;
+    FiberWaiter waiter;
+    waiter.prepare(&sem);
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_waiters.push_back(waiter);
+    }
+    // 先入队再解锁 -> 解锁后的notify一定能看到自己
+    lock.unlock();
+    waiter.wait();
+    lock.lock();
+}
+
+void FiberConditionVariable::notify_one()
+{
+    FiberWaiter waiter;
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if(m_waiters.empty())
+        {
+            return;
+        }
+        waiter = std::move(m_waiters.front());
+        m_waiters.pop_front();
+    }
+    waiter.wake();
+}
+
+void FiberConditionVariable::notify_all()
+{
+    std::deque<FiberWaiter> waiters;
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        waiters.swap(m_waiters);
+    }
+    for(FiberWaiter& waiter : waiters)
+    {
+        waiter.wake();
+    }
+}
+
+bool FiberSemaphore::tryWait()
+{
+    size_t count = m_count.load();
+    while(count > 0)
+    {
+        if(m_count.compare_exchange_weak(count, count - 1))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FiberSemaphore::wait()
+{
+    if(Spin([this](){ return tryWait(); }))
+    {
+        return;
+    }
+
+    Semaphore sem;
+    FiberWaiter waiter;
+    waiter.prepare(&sem);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_waiting++;
+        if(tryWait())
+        {
+            m_waiting--;
+            return;
+        }
+        m_waiters.push_back(waiter);
+    }
+    // 醒来时计数已经交给自己
+    waiter.wait();
+}
+
+void FiberSemaphore::signal()
+{
+    m_count++;
+    if(m_waiting == 0)
+    {
+        return;
+    }
+
+    FiberWaiter waiter;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_waiters.empty() || !tryWait())
+        {
+            return;
+        }
+        waiter = std::move(m_waiters.front());
+        m_waiters.pop_front();
+        m_waiting--;
+    }
+    waiter.wake();
+}
+
+bool FiberRWMutex::try_lock()
+{
+    int state = 0;
+    return m_state.compare_exchange_strong(state, -1);
+}
+
+bool FiberRWMutex::try_lock_shared()
+{
+    // 写优先 -> 有写者排队时不再放行新的读者
+    if(m_writersWaiting > 0)
+    {
+        return false;
+    }
+    int state = m_state.load();
+    while(state >= 0)
+    {
+        if(m_state.compare_exchange_weak(state, state + 1))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FiberRWMutex::lock()
+{
+    if(Spin([this](){ return try_lock(); }))
+    {
+        return;
+    }
+
+    Semaphore sem;
+    FiberWaiter waiter;
+    waiter.prepare(&sem);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_waiting++;
+        m_writersWaiting++;
+        if(try_lock())
+        {
+            m_writersWaiting--;
+            m_waiting--;
+            return;
+        }
+        m_writers.push_back(waiter);
+    }
+    waiter.wait();
+}
+
+void FiberRWMutex::lock_shared()
+{
+    if(Spin([this](){ return try_lock_shared(); }))
+    {
+        return;
+    }
+
+    Semaphore sem;
+    FiberWaiter waiter;
+    waiter.prepare(&sem);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_waiting++;
+        if(try_lock_shared())
+        {
+            m_waiting--;
+            return;
+        }
+        m_readers.push_back(waiter);
+    }
+    waiter.wait();
+}
+
+void FiberRWMutex::unlock()
+{
+    m_state = 0;
+    if(m_waiting == 0)
+    {
+        return;
+    }
+
+    std::deque<FiberWaiter> woken;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        dispatch(true, woken);
+    }
+    for(FiberWaiter& waiter : woken)
+    {
+        waiter.wake();
+    }
+}
+
+void FiberRWMutex::unlock_shared()
+{
+    // 不是最后一个读者 -> 锁仍被持有
+    if(m_state.fetch_sub(1) != 1 || m_waiting == 0)
+    {
+        return;
+    }
+
+    std::deque<FiberWaiter> woken;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        dispatch(false, woken);
+    }
+    for(FiberWaiter& waiter : woken)
+    {
+        waiter.wake();
+    }
+}
+
+void FiberRWMutex::dispatch(bool writer_released, std::deque<FiberWaiter>& woken)
+{
+    // 写锁释放后先放行排队的读者, 否则放行一个写者
+    if(!m_readers.empty() && (writer_released || m_writers.empty()))
+    {
+        int n = (int)m_readers.size();
+        int state = m_state.load();
+        while(state >= 0)
+        {
+            if(m_state.compare_exchange_weak(state, state + n))
+            {
+                woken.swap(m_readers);
+                m_waiting -= n;
+                return;
+            }
+        }
+        // 被写者抢先拿到 -> 由它释放时放行
+        return;
+    }
+
+    if(!m_writers.empty() && try_lock())
+    {
+        woken.push_back(std::move(m_writers.front()));
+        m_writers.pop_front();
+        m_writersWaiting--;
+        m_waiting--;
+    }
+}
+
+}
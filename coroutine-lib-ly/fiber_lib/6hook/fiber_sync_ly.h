@@ -0,0 +1,140 @@
+#ifndef _FIBER_SYNC_LY_H_
+#define _FIBER_SYNC_LY_H_
+
+#include "thread_ly.h"
+#include "fiber_ly.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace sylar
+{
+
+class Scheduler;
+
+// 协程同步原语: 等待时只挂起当前协程, 释放时通过Scheduler::scheduleLock重新调度它, 不阻塞工作线程
+// 挂起前先自旋一小段时间, 临界区很短时不必切换协程
+// 在调度器之外(主线程等)调用时退回阻塞线程
+// FiberMutex唤醒后重新竞争(同时最多唤醒一个), FiberSemaphore和FiberRWMutex唤醒时直接把计数/锁交给被唤醒者
+
+// 挂起在同步原语上的协程或线程
+struct FiberWaiter
+{
+    std::shared_ptr<Fiber> fiber;
+    Scheduler* scheduler = nullptr;
+    // 不在协程中 -> 线程阻塞在自己栈上的信号量上
+    Semaphore* sem = nullptr;
+
+    // 记录当前协程, 不在调度器的协程中时使用sem
+    void prepare(Semaphore* thread_sem);
+    // 挂起直到wake()
+    void wait();
+    // 可以在wait()之前调用: 调度器恢复协程前会等它挂起
+    void wake();
+};
+
+class FiberMutex
+{
+public:
+    FiberMutex() = default;
+    FiberMutex(const FiberMutex&) = delete;
+    FiberMutex& operator=(const FiberMutex&) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+private:
+    std::atomic<bool> m_locked = {false};
+    // 排队的等待者数, 为0时unlock()不加锁
+    std::atomic<size_t> m_waiting = {0};
+    // 有被唤醒但还没开始竞争的等待者
+    std::atomic<bool> m_wakeup = {false};
+    // 保护m_waiters
+    std::mutex m_mutex;
+    std::deque<FiberWaiter> m_waiters;
+};
+
+class FiberConditionVariable
+{
+public:
+    FiberConditionVariable() = default;
+    FiberConditionVariable(const FiberConditionVariable&) = delete;
+    FiberConditionVariable& operator=(const FiberConditionVariable&) = delete;
+
+    // 释放锁并挂起, 被唤醒后重新加锁
+    void wait(std::unique_lock<FiberMutex>& lock);
+
+    template<class Predicate>
+    void wait(std::unique_lock<FiberMutex>& lock, Predicate pred)
+    {
+        while(!pred())
+        {
+            wait(lock);
+        }
+    }
+
+    void notify_one();
+    void notify_all();
+
+private:
+    std::mutex m_mutex;
+    std::deque<FiberWaiter> m_waiters;
+};
+
+class FiberSemaphore
+{
+public:
+    explicit FiberSemaphore(size_t count = 0) : m_count(count) {}
+    FiberSemaphore(const FiberSemaphore&) = delete;
+    FiberSemaphore& operator=(const FiberSemaphore&) = delete;
+
+    // p
+    void wait();
+    bool tryWait();
+    // v
+    void signal();
+
+private:
+    std::atomic<size_t> m_count;
+    std::atomic<size_t> m_waiting = {0};
+    std::mutex m_mutex;
+    std::deque<FiberWaiter> m_waiters;
+};
+
+// 读写锁, 写优先: 有写者排队时新的读者也排队; 写锁释放时先放行排队的读者, 读写双方都不会饿死
+class FiberRWMutex
+{
+public:
+    FiberRWMutex() = default;
+    FiberRWMutex(const FiberRWMutex&) = delete;
+    FiberRWMutex& operator=(const FiberRWMutex&) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+    void lock_shared();
+    bool try_lock_shared();
+    void unlock_shared();
+
+private:
+    // 把锁交给排队者, 需要持有m_mutex, 被放行的等待者移入woken, 释放m_mutex后再唤醒
+    // writer_released: 刚释放的是写锁
+    void dispatch(bool writer_released, std::deque<FiberWaiter>& woken);
+
+private:
+    // >0 读者数, -1 写者持有, 0 空闲
+    std::atomic<int> m_state = {0};
+    std::atomic<size_t> m_waiting = {0};
+    std::atomic<size_t> m_writersWaiting = {0};
+    std::mutex m_mutex;
+    std::deque<FiberWaiter> m_readers;
+    std::deque<FiberWaiter> m_writers;
+};
+
+}
+
+#endif
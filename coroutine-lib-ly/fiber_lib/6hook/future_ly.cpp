@@ -0,0 +1,85 @@
+#include "future_ly.h"
+
+namespace sylar {
+
+void FutureStateBase::wait()
+{
+    if(m_ready)
+    {
+        return;
+    }
+
+    Semaphore sem;
+    FiberWaiter waiter;
+    waiter.prepare(&sem);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_ready)
+        {
+            return;
+        }
+        m_waiters.push_back(waiter);
+    }
+    waiter.wait();
+}
+
+void FutureStateBase::onReady(std::function<void()> cb)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!m_ready)
+        {
+            m_callbacks.push_back(std::move(cb));
+            return;
+        }
+    }
+    cb();
+}
+
+void FutureStateBase::setException(std::exception_ptr e)
+{
+    checkUnset();
+    m_exception = e;
+    markReady();
+}
+
+void FutureStateBase::checkUnset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_set)
+    {
+        throw std::future_error(std::future_errc::promise_already_satisfied);
+    }
+    m_set = true;
+}
+
+void FutureStateBase::markReady()
+{
+    std::vector<FiberWaiter> waiters;
+    std::vector<std::function<void()>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready = true;
+        waiters.swap(m_waiters);
+        // 取出后状态不再持有回调 -> WhenAll等回调中捕获的上下文可以释放
+        callbacks.swap(m_callbacks);
+    }
+    for(FiberWaiter& waiter : waiters)
+    {
+        waiter.wake();
+    }
+    for(std::function<void()>& cb : callbacks)
+    {
+        cb();
+    }
+}
+
+void FutureStateBase::rethrowIfException()
+{
+    if(m_exception)
+    {
+        std::rethrow_exception(m_exception);
+    }
+}
+
+}
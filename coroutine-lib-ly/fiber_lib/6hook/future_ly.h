@@ -0,0 +1,296 @@
+#ifndef _FUTURE_LY_H_
+#define _FUTURE_LY_H_
+
+#include "fiber_sync_ly.h"
+#include "scheduler_ly.h"
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace sylar
+{
+
+// 协程版的Future/Promise: get()只挂起当前协程(不在调度器协程中时阻塞线程), 不阻塞工作线程
+// Spawn(cb)调度一个任务并返回JoinHandle, join()拿到返回值或重新抛出任务中的异常
+// WhenAll/WhenAny组合多个Future, 完成回调在设置结果的线程上运行
+
+// 结果之外的共享状态
+class FutureStateBase
+{
+public:
+    bool isReady() const {return m_ready;}
+    // 挂起直到结果就绪
+    void wait();
+    // 就绪时调用cb, 已就绪则立即调用
+    void onReady(std::function<void()> cb);
+
+    void setException(std::exception_ptr e);
+
+protected:
+    ~FutureStateBase() = default;
+
+    // 结果写好之后调用, 唤醒等待者并运行完成回调
+    void markReady();
+    // 已设置过结果 -> 抛出promise_already_satisfied
+    void checkUnset();
+    void rethrowIfException();
+
+protected:
+    std::exception_ptr m_exception;
+
+private:
+    std::atomic<bool> m_ready = {false};
+    // 结果已被设置(可能还没就绪)
+    bool m_set = false;
+    // 保护以下成员和m_set
+    std::mutex m_mutex;
+    std::vector<FiberWaiter> m_waiters;
+    std::vector<std::function<void()>> m_callbacks;
+};
+
+template<class T>
+class FutureState : public FutureStateBase
+{
+public:
+    template<class U>
+    void setValue(U&& value)
+    {
+        checkUnset();
+        m_value.emplace(std::forward<U>(value));
+        markReady();
+    }
+
+    // 就绪后取走结果, 只能调用一次
+    T take()
+    {
+        rethrowIfException();
+        return std::move(*m_value);
+    }
+
+private:
+    std::optional<T> m_value;
+};
+
+template<>
+class FutureState<void> : public FutureStateBase
+{
+public:
+    void setValue()
+    {
+        checkUnset();
+        markReady();
+    }
+
+    void take()
+    {
+        rethrowIfException();
+    }
+};
+
+template<class T>
+class Future
+{
+public:
+    Future() = default;
+    explicit Future(std::shared_ptr<FutureState<T>> state) : m_state(std::move(state)) {}
+
+    bool valid() const {return m_state != nullptr;}
+    bool isReady() const {return m_state->isReady();}
+    void wait() const {m_state->wait();}
+
+    // 挂起直到就绪, 返回结果或重新抛出异常; 之后Future失效
+    T get()
+    {
+        std::shared_ptr<FutureState<T>> state = std::move(m_state);
+        state->wait();
+        return state->take();
+    }
+
+    const std::shared_ptr<FutureState<T>>& state() const {return m_state;}
+
+private:
+    std::shared_ptr<FutureState<T>> m_state;
+};
+
+template<class T>
+class Promise
+{
+public:
+    Promise() : m_state(std::make_shared<FutureState<T>>()) {}
+    Promise(Promise&&) = default;
+    Promise& operator=(Promise&&) = default;
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
+
+    // 没有设置结果就销毁 -> Future得到broken_promise异常
+    ~Promise()
+    {
+        if(m_state && !m_state->isReady())
+        {
+            try
+            {
+                m_state->setException(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+            }
+            catch(const std::future_error&)
+            {
+                // 其他线程正在设置结果
+            }
+        }
+    }
+
+    Future<T> getFuture() {return Future<T>(m_state);}
+
+    // T为void时不带参数
+    template<class... Args>
+    void setValue(Args&&... args) {m_state->setValue(std::forward<Args>(args)...);}
+    void setException(std::exception_ptr e) {m_state->setException(e);}
+
+private:
+    std::shared_ptr<FutureState<T>> m_state;
+};
+
+// 等待Spawn出去的任务结束
+template<class T>
+class JoinHandle
+{
+public:
+    JoinHandle() = default;
+    explicit JoinHandle(Future<T> future) : m_future(std::move(future)) {}
+
+    bool joinable() const {return m_future.valid();}
+    bool isFinished() const {return m_future.isReady();}
+
+    // 挂起直到任务结束, 返回任务的返回值或重新抛出任务中的异常
+    T join() {return m_future.get();}
+
+    Future<T>& future() {return m_future;}
+
+private:
+    Future<T> m_future;
+};
+
+// 运行cb并把结果写入state
+template<class T, class F>
+void RunInto(const std::shared_ptr<FutureState<T>>& state, F&& cb)
+{
+    try
+    {
+        if constexpr(std::is_void<T>::value)
+        {
+            cb();
+            state->setValue();
+        }
+        else
+        {
+            state->setValue(cb());
+        }
+    }
+    catch(...)
+    {
+        state->setException(std::current_exception());
+    }
+}
+
+// 在scheduler(默认为当前调度器)上调度cb, 丢弃JoinHandle即分离任务
+template<class F, class T = std::invoke_result_t<std::decay_t<F>&>>
+JoinHandle<T> Spawn(F&& cb, Scheduler* scheduler = nullptr, int thread = -1)
+{
+    if(!scheduler)
+    {
+        scheduler = Scheduler::GetThis();
+    }
+    auto state = std::make_shared<FutureState<T>>();
+    // std::function需要可拷贝 -> 回调放在shared_ptr中
+    auto fn = std::make_shared<std::decay_t<F>>(std::forward<F>(cb));
+    scheduler->scheduleLock([state, fn](){ RunInto(state, *fn); }, thread);
+    return JoinHandle<T>(Future<T>(state));
+}
+
+// 全部就绪后就绪, 结果按输入顺序排列; 有异常时得到下标最小的那个异常
+template<class T>
+auto WhenAll(std::vector<Future<T>> futures)
+{
+    using Result = std::conditional_t<std::is_void<T>::value, void, std::vector<T>>;
+
+    struct Context
+    {
+        std::vector<Future<T>> futures;
+        std::atomic<size_t> remaining;
+        Promise<Result> promise;
+    };
+    auto ctx = std::make_shared<Context>();
+    Future<Result> result = ctx->promise.getFuture();
+    ctx->futures = std::move(futures);
+    ctx->remaining = ctx->futures.size() + 1;
+
+    // 最后一个就绪的负责收集结果
+    auto finish = [ctx]()
+    {
+        if(--ctx->remaining != 0)
+        {
+            return;
+        }
+        RunInto<Result>(ctx->promise.getFuture().state(), [&ctx]()
+        {
+            if constexpr(std::is_void<T>::value)
+            {
+                for(Future<T>& f : ctx->futures)
+                {
+                    f.get();
+                }
+            }
+            else
+            {
+                std::vector<T> values;
+                values.reserve(ctx->futures.size());
+                for(Future<T>& f : ctx->futures)
+                {
+                    values.push_back(f.get());
+                }
+                return values;
+            }
+        });
+    };
+    for(Future<T>& f : ctx->futures)
+    {
+        f.state()->onReady(finish);
+    }
+    // 多计的1在注册完之后减掉 -> 注册期间就绪的不会提前收集
+    finish();
+    return result;
+}
+
+// 任意一个就绪后就绪, 结果是它的下标; 结果仍留在futures中, 调用方之后get()
+template<class T>
+Future<size_t> WhenAny(const std::vector<Future<T>>& futures)
+{
+    struct Context
+    {
+        std::atomic<bool> done = {false};
+        Promise<size_t> promise;
+    };
+    auto ctx = std::make_shared<Context>();
+    Future<size_t> result = ctx->promise.getFuture();
+    for(size_t i = 0; i < futures.size(); i++)
+    {
+        futures[i].state()->onReady([ctx, i]()
+        {
+            if(!ctx->done.exchange(true))
+            {
+                ctx->promise.setValue(i);
+            }
+        });
+    }
+    return result;
+}
+
+}
+
+#endif
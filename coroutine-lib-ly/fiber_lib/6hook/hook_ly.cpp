@@ -5,6 +5,7 @@
 #include <cstdarg>
 #include "fd_manager_ly.h"
 #include <string.h>
+#include <type_traits>
 
 // apply XX to all functions
 #define HOOK_FUN(XX) \
@@ -79,15 +80,144 @@ static HookIniter s_hook_initer;//定义了一个静态的 HookIniter 实例。
 
 } // end namespace sylar
 
+// 协程可能在另一个线程上恢复, 而errno的地址(__errno_location()被声明为const)可能被编译器缓存到yield()之后
+// -> 会读写原来线程的errno. 通过volatile函数指针调用, 每次都重新取当前线程的errno
+static int* (*volatile s_errno_location)() = &__errno_location;
+
+static inline int& current_errno()
+{
+    return *s_errno_location();
+}
+
 // 用于跟踪定时器的状态。具体来说，它有一个cancelled成员变量，通常用于表示定时器是否已经被取消。
 struct timer_info 
 {
     int cancelled = 0;
 };
 
+// 一次I/O等待的超时槽, 放在等待协程的栈上
+// 超时用嵌入的TimerEntry挂在当前工作线程的定时器分片上, 添加/取消都不分配内存
+// 回调在取超时timer时直接执行: 标记超时并取消等待的事件 -> 协程被唤醒
+// 共享栈协程挂起期间栈会被其他协程覆盖 -> 退回条件timer
+class IoDeadline
+{
+public:
+    IoDeadline(sylar::IOManager* iom, int fd, uint32_t event):
+    m_iom(iom), m_fd(fd), m_event(event), m_entry(&IoDeadline::OnTimeout, this)
+    {
+    }
+
+    ~IoDeadline()
+    {
+        cancel();
+    }
+
+    // 挂起前调用, 微秒, -1表示不超时
+    void arm(uint64_t timeout_us)
+    {
+        if(timeout_us == (uint64_t)-1)
+        {
+            return;
+        }
+
+        if(!sylar::Fiber::GetThis()->isSharedStack())
+        {
+            m_iom->addTimer(m_entry, std::chrono::microseconds(timeout_us));
+            return;
+        }
+
+        if(!m_info)
+        {
+            m_info.reset(new timer_info);
+        }
+        std::weak_ptr<timer_info> winfo(m_info);
+        sylar::IOManager* iom = m_iom;
+        int fd = m_fd;
+        uint32_t event = m_event;
+        m_timer = m_iom->addConditionTimer(std::chrono::microseconds(timeout_us), [winfo, fd, iom, event]() 
+        {
+            auto t = winfo.lock();
+            if(!t || t->cancelled) 
+            {
+                return;
+            }
+            t->cancelled = ETIMEDOUT;
+            iom->cancelEvent(fd, (sylar::IOManager::Event)(event));
+        }, winfo);
+    }
+
+    // 恢复后调用, 返回后回调不会再执行
+    void cancel()
+    {
+        m_entry.cancel();
+        if(m_timer)
+        {
+            m_timer->cancel();
+            m_timer.reset();
+        }
+    }
+
+    // 等待因超时被取消 -> ETIMEDOUT, 否则为0, 在cancel()之后读取
+    int cancelled() const
+    {
+        return m_info ? m_info->cancelled : m_cancelled;
+    }
+
+private:
+    static void OnTimeout(void* arg)
+    {
+        IoDeadline* self = static_cast<IoDeadline*>(arg);
+        self->m_cancelled = ETIMEDOUT;
+        self->m_iom->cancelEvent(self->m_fd, (sylar::IOManager::Event)(self->m_event));
+    }
+
+private:
+    sylar::IOManager* m_iom;
+    int m_fd;
+    uint32_t m_event;
+    sylar::TimerEntry m_entry;
+    int m_cancelled = 0;
+
+    // 共享栈协程
+    std::shared_ptr<timer_info> m_info;
+    std::shared_ptr<sylar::Timer> m_timer;
+};
+
+// io_uring后端: 提交操作并挂起, 完成时直接得到结果, 不需要注册epoll事件后再重试
+// 超时 -> 取消操作, 返回-1且errno为ETIMEDOUT
+// 返回-2表示操作被cancelAll取消(fd被关闭), 由调用方重试
+// timeout_us: 微秒, -1表示不超时
+static ssize_t do_uring_io(sylar::IOManager* iom, int fd, uint32_t event, uint64_t timeout_us, const io_uring_sqe& sqe)
+{
+    // 超时 -> cancel the operation -> it completes with -ECANCELED
+    IoDeadline deadline(iom, fd, event);
+    deadline.arm(timeout_us);
+
+    int rt = iom->submitIo(fd, (sylar::IOManager::Event)(event), sqe);
+    deadline.cancel();
+
+    // 超时与完成同时发生时以完成结果为准, 数据已经被读走
+    if(rt == -ECANCELED)
+    {
+        if(deadline.cancelled())
+        {
+            current_errno() = deadline.cancelled();
+            return -1;
+        }
+        return -2;
+    }
+    if(rt < 0)
+    {
+        current_errno() = -rt;
+        return -1;
+    }
+    return rt;
+}
+
 // universal template for read and write function
-template<typename OriginFun, typename... Args>
-static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t event, int timeout_so, Args&&... args)
+// prep: 为io_uring后端准备SQE, nullptr表示该操作只使用epoll等待
+template<typename OriginFun, typename Prep, typename... Args>
+static ssize_t do_io(int fd, OriginFun fun, Prep prep, const char* hook_fun_name, uint32_t event, int timeout_so, Args&&... args)
 {
     if(!sylar::t_hook_enable) 
     {  
@@ -97,7 +227,7 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t
 
     // //获取与文件描述符 fd 相关联的上下文 ctx。如果上下文不存在，则直接调用原始的 I/0 函数。
     //typedef singleton<FdManager>FdMgr各位彦祖不要忘记了。
-    std::shared_ptr<sylar::FdCtx> ctx = sylar::FdMgr::GetInstance()->get(fd);
+    sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd);
     if(!ctx) 
     {
         return fun(fd, std::forward<Args>(args)...);
@@ -117,10 +247,8 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t
     }
 
     // get the timeout
-    //获取超时设置并初始化timer info结构体，用于后续的超时管理和取消操作。
-    uint64_t timeout = ctx->getTimeout(timeout_so);
-    // timer condition
-    std::shared_ptr<timer_info> tinfo(new timer_info);
+    //获取超时设置，等待时用栈上的超时槽管理超时和取消操作。
+    uint64_t timeout = ctx->getTimeout(timeout_so); // 微秒
 
 //调用原始的I/0函数，如果由于系统中断(EINTR)导致操作失败，函数会重试。
 retry:
@@ -128,37 +256,40 @@ retry:
     ssize_t n = fun(fd, std::forward<Args>(args)...);
 
     // EINTR ->Operation interrupted by system ->retry
-    while(n == -1 && errno == EINTR) 
+    while(n == -1 && current_errno() == EINTR) 
     {
         n = fun(fd, std::forward<Args>(args)...);
     }
 
     // 0 resource was temporarily unavailable -> retry until ready 
     //如果I/0操作因为资源暂时不可用(EAGAIN)而失败，函数会添加一个事件监听器来等待资源可用。同时，如果有超时设置，还会启动一个条件计时器来取消事件
-    if(n == -1 && errno == EAGAIN) 
+    if(n == -1 && current_errno() == EAGAIN) 
     {
         sylar::IOManager* iom = sylar::IOManager::GetThis();
-        // timer
-        std::shared_ptr<sylar::Timer> timer;
-        std::weak_ptr<timer_info> winfo(tinfo);
 
-        // 1 timeout has been set -> add a conditional timer for canceling this operation
-        //如果执行的read等函数在Fdmanager管理的Fdctx中fd设置了超时时间，就会走到这里。添加addconditionTimer事件
-        if(timeout != (uint64_t)-1) 
+        if constexpr(!std::is_null_pointer<Prep>::value)
         {
-            timer = iom->addConditionTimer(timeout, [winfo, fd, iom, event]() 
+            if(iom->getBackend() == sylar::IOManager::IO_URING)
             {
-                auto t = winfo.lock();
-                //如果 timer info 对象已被释放(!t)，或者操作已被取消(t->cancelled 非 )，则直接返回,
-                if(!t || t->cancelled) 
+                io_uring_sqe sqe;
+                prep(&sqe);
+                n = do_uring_io(iom, fd, event, timeout, sqe);
+                // fd被关闭 -> 重试得到EBADF, 与epoll后端一致
+                if(n == -2)
+                {
+                    goto retry;
+                }
+                // 同方向已有操作在等待或SQ已满 -> 退回epoll等待
+                if(!(n == -1 && (current_errno() == EBUSY || current_errno() == EAGAIN)))
                 {
-                    return;
+                    return n;
                 }
-                t->cancelled = ETIMEDOUT;
-                // cancel this event and trigger once to return to this fiber
-                iom->cancelEvent(fd, (sylar::IOManager::Event)(event));
-            }, winfo);
+            }
         }
+        // 1 timeout has been set -> arm the deadline for canceling this operation
+        //如果执行的read等函数在Fdmanager管理的Fdctx中fd设置了超时时间，就会走到这里。超时时取消事件并触发一次，回到这个协程
+        IoDeadline deadline(iom, fd, event);
+        deadline.arm(timeout);
 
         // 2 add event -> callback is this fiber
         // 这行代码的作用是将 fd(文件描述符)和 event(要监听的事件，如读或写事件)添加到 I0Manager 中进行管理。I0Manager 会监听这个文件描述符上的事件。当事件触发，调度相应协程处理事件。
@@ -167,10 +298,7 @@ retry:
         {
             //如果 rt 为-1，说明 addEvent 失败。此时，会打印一条调试信息，并且因为添加事件失败所以要取消之前设置的定时器，避免误触发。
             std::cout << hook_fun_name << " addEvent("<< fd << ", " << event << ")";
-            if(timer) 
-            {
-                timer->cancel();
-            }
+            deadline.cancel();
             return -1;
         } 
         else 
@@ -180,16 +308,13 @@ retry:
      
             // 3 resume either by addEvent or cancelEvent
             // 当协程被恢复时(例如，事件触发后)，它会继续执行yield()之后的代码。
-            // 如果之前设置了定时器(timer 不为 nullptr)，则在事件处理完毕后取消该定时器。取消定时器的原因是，该定时器的唯一目的是在 I/0 操作超时时取消事件。 如果事件正常处理完毕，那么就不再需要定时器了。
-            if(timer) 
-            {
-                timer->cancel();
-            }
+            // 取消超时槽。它的唯一目的是在 I/0 操作超时时取消事件。 如果事件正常处理完毕，那么就不再需要它了；cancel()返回后回调不会再执行。
+            deadline.cancel();
             // by cancelEvent
-            //接下来检査 tinfo->cancelled 是否等于 ETIMEDOUT。如果等于，说明该操作因超时而被取消，因此设置errno为 ETIMEDOUT 并返回 -1，表示操作失败
-            if(tinfo->cancelled == ETIMEDOUT) 
+            //接下来检査 deadline.cancelled() 是否等于 ETIMEDOUT。如果等于，说明该操作因超时而被取消，因此设置errno为 ETIMEDOUT 并返回 -1，表示操作失败
+            if(deadline.cancelled() == ETIMEDOUT) 
             {
-                errno = tinfo->cancelled;
+                current_errno() = deadline.cancelled();
                 return -1;
             }
             //如果没有超时，则跳转到 retry 标签，重新尝试这个操作。
@@ -235,7 +360,7 @@ int usleep(useconds_t usec)
 	std::shared_ptr<sylar::Fiber> fiber = sylar::Fiber::GetThis();
 	sylar::IOManager* iom = sylar::IOManager::GetThis();
 	// add a timer to reschedule this fiber
-	iom->addTimer(usec/1000, [fiber, iom](){iom->scheduleLock(fiber);});
+	iom->addTimer(std::chrono::microseconds(usec), [fiber, iom](){iom->scheduleLock(fiber);});
 	// wait for the next resume
 	fiber->yield();
 	return 0;
@@ -247,13 +372,13 @@ int nanosleep(const struct timespec* req, struct timespec* rem)
 	{
 		return nanosleep_f(req, rem);
 	}	
-    //timeout ms 将 tv sec 转换为毫秒，并将 tv nsec 转换为毫秒，然后两者相加得到总的超时毫秒数。所以从这里看出实现的也是一个毫秒级的操作。
-	int timeout_ms = req->tv_sec*1000 + req->tv_nsec/1000/1000;
+    // 纳秒精度, 高精度等待模式下(IOManager::setHighResTimer)按纳秒超时唤醒
+	std::chrono::nanoseconds timeout = std::chrono::seconds(req->tv_sec) + std::chrono::nanoseconds(req->tv_nsec);
 
 	std::shared_ptr<sylar::Fiber> fiber = sylar::Fiber::GetThis();
 	sylar::IOManager* iom = sylar::IOManager::GetThis();
 	// add a timer to reschedule this fiber
-	iom->addTimer(timeout_ms, [fiber, iom](){iom->scheduleLock(fiber, -1);});
+	iom->addTimer(timeout, [fiber, iom](){iom->scheduleLock(fiber, -1);});
 	// wait for the next resume
 	fiber->yield();	
 	return 0;
@@ -263,7 +388,19 @@ int socket(int domain, int type, int protocol)
 {
 	if(!sylar::t_hook_enable)
 	{
-		return socket_f(domain, type, protocol);
+		int fd = socket_f(domain, type, protocol);
+		// 不登记新fd; 但同号的旧fd若没有经过hook的close, 槽位仍标记为使用中,
+		// 之后在开启hook的线程上使用这个fd会拿到旧fd的超时/非阻塞设置和epoll登记 -> 清掉
+		// 只在槽位确实在使用时才碰fd表, 也不为此创建FdManager
+		if(fd >= 0)
+		{
+			sylar::FdManager* mgr = sylar::FdMgr::FindInstance();
+			if(mgr && mgr->get(fd))
+			{
+				mgr->del(fd);
+			}
+		}
+		return fd;
 	}	
     // 如果钩子启用了，则通过调用原始的 socket 函数创建套接字，并将返回的文件描述符存储在 fd 变量中
 	int fd = socket_f(domain, type, protocol);
@@ -273,7 +410,7 @@ int socket(int domain, int type, int protocol)
 		return fd;
 	}
     // 如果socket创建成功会利用Fdmanager的文件描述符管理类来进行管理，判断是否在其管理的文件描述符中，如果不在扩展存储文件描述数组大小，并且利用FDctx进行初始化判断是不是套接字，是不是系统非阻塞模式。
-	sylar::FdMgr::GetInstance()->get(fd, true);
+	sylar::FdMgr::GetInstance()->renew(fd);
 	return fd;
 }
 
@@ -284,7 +421,7 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         return connect_f(fd, addr, addrlen);
     }
 
-    std::shared_ptr<sylar::FdCtx> ctx = sylar::FdMgr::GetInstance()->get(fd); //获取文件描述符 fd 的上下文信息 Fdctx
+    sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd); //获取文件描述符 fd 的上下文信息 Fdctx
     if(!ctx || ctx->isClosed()) //检查文件描述符上下文是否存在或是否已关闭。
     {
         errno = EBADF;//EBAD表示一个无效的文件描述符
@@ -302,6 +439,25 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         return connect_f(fd, addr, addrlen);
     }
 
+    // io_uring后端 -> 直接提交connect, 完成时得到连接结果
+    sylar::IOManager* uring_iom = sylar::IOManager::GetThis();
+    if(uring_iom && uring_iom->getBackend() == sylar::IOManager::IO_URING)
+    {
+        io_uring_sqe sqe;
+        sylar::IoUring::PrepConnect(&sqe, fd, addr, addrlen);
+        int n = do_uring_io(uring_iom, fd, sylar::IOManager::WRITE, timeout_ms == (uint64_t)-1 ? timeout_ms : timeout_ms * 1000, sqe);
+        if(n == -2)
+        {
+            current_errno() = EBADF;
+            return -1;
+        }
+        // 同方向已有操作在等待 -> 按epoll方式连接
+        if(!(n == -1 && (current_errno() == EBUSY || current_errno() == EAGAIN)))
+        {
+            return n;
+        }
+    }
+
     // attempt to connect
     //尝试进行 connect 操作，返回值存储在 n 中。
     int n = connect_f(fd, addr, addrlen); 
@@ -309,7 +465,7 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
     {
         return 0;
     } 
-    else if(n != -1 || errno != EINPROGRESS) // 连接明确失败​
+    else if(n != -1 || current_errno() != EINPROGRESS) // 连接明确失败​
     {
         return n;
     }
@@ -318,24 +474,12 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
 
     // wait for write event is ready -> connect succeeds
     sylar::IOManager* iom = sylar::IOManager::GetThis(); //获取当前线程的 IOManager 实例。
-    std::shared_ptr<sylar::Timer> timer; //声明一个定时器对象。
-    std::shared_ptr<timer_info> tinfo(new timer_info); //创建追踪定时器是否取消的对象
-    std::weak_ptr<timer_info> winfo(tinfo); //判断追踪定时器对象是否存在
-    // //检査是否设置了超时时间。如果 timeout ms 不等于 -1，则创建一个定时器。
+    // 超时槽: 超时时间到达时，取消事件监听并设置 cancelled 状态。
+    IoDeadline deadline(iom, fd, sylar::IOManager::WRITE);
+    //检査是否设置了超时时间。如果 timeout ms 不等于 -1，则设置超时。
     if(timeout_ms != (uint64_t)-1) 
     {
-        // 添加一个定时器，当超时时间到达时，取消事件监听并设置 cancelled 状态。
-        timer = iom->addConditionTimer(timeout_ms, [winfo, fd, iom]() 
-        {
-            //判断追踪定时器对象是否存在或者追踪定时器的成员变量是否大于0.大于0就意味着取消了
-            auto t = winfo.lock();
-            if(!t || t->cancelled) 
-            {
-                return;
-            }
-            t->cancelled = ETIMEDOUT; //如果超时了但时间任然未处理
-            iom->cancelEvent(fd, sylar::IOManager::WRITE); //将指定的fd的事件触发将事件处理
-        }, winfo);
+        deadline.arm(timeout_ms * 1000);
     }
 
     //为文件描述符 fd 添加一个写事件监听器。这样的目的是为了上面的回调函数处理指定文件描述符
@@ -345,23 +489,17 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         sylar::Fiber::GetThis()->yield();
 
         // resume either by addEvent or cancelEvent
-        if(timer) //如果有定时器，取消定时器。
-        {
-            timer->cancel();
-        }
+        deadline.cancel(); //取消超时槽。
 
-        if(tinfo->cancelled) //发生超时错误或者用户取消
+        if(deadline.cancelled()) //发生超时错误或者用户取消
         {
-            errno = tinfo->cancelled;
+            current_errno() = deadline.cancelled();
             return -1;
         }
     } 
     else //添加事件失败
     {
-        if(timer) //如果有定时器，取消定时器。
-        {
-            timer->cancel();
-        }
+        deadline.cancel(); //取消超时槽。
         std::cerr << "connect addEvent(" << fd << ", WRITE) error";
     }
 
@@ -379,7 +517,7 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
     } 
     else //如果有错误，设置 errno 并返回错误。
     {
-        errno = error; // errno是线程局部的
+        current_errno() = error; // errno是线程局部的
         return -1;
     }
 }
@@ -392,10 +530,10 @@ int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
 
 int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
 {
-	int fd = do_io(sockfd, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen);	
+	int fd = do_io(sockfd, accept_f, [=](io_uring_sqe* sqe){sylar::IoUring::PrepAccept(sqe, sockfd, addr, addrlen, 0);}, "accept", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen);	
 	if(fd>=0)
 	{
-		sylar::FdMgr::GetInstance()->get(fd, true);
+		sylar::FdMgr::GetInstance()->renew(fd);
 	}
 	return fd;
 }
@@ -418,52 +556,59 @@ addr和addrlen:用于保存新链接的客户端地址信息。
 */
 ssize_t read(int fd, void *buf, size_t count)
 {
-	return do_io(fd, read_f, "read", sylar::IOManager::READ, SO_RCVTIMEO, buf, count);	
+	return do_io(fd, read_f, [=](io_uring_sqe* sqe){sylar::IoUring::PrepRecv(sqe, fd, buf, count, 0);}, "read", sylar::IOManager::READ, SO_RCVTIMEO, buf, count);	
 }
 
 ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
 {
-	return do_io(fd, readv_f, "readv", sylar::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);	
+	// 旧内核上非阻塞socket的IORING_OP_READV直接返回EAGAIN -> 用RECVMSG, msghdr在完成前一直有效
+	struct msghdr msg = {};
+	msg.msg_iov = (struct iovec*)iov;
+	msg.msg_iovlen = iovcnt;
+	return do_io(fd, readv_f, [&](io_uring_sqe* sqe){sylar::IoUring::PrepRecvmsg(sqe, fd, &msg, 0);}, "readv", sylar::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);	
 }
 
 ssize_t recv(int sockfd, void *buf, size_t len, int flags)
 {
-	return do_io(sockfd, recv_f, "recv", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags);	
+	return do_io(sockfd, recv_f, [=](io_uring_sqe* sqe){sylar::IoUring::PrepRecv(sqe, sockfd, buf, len, flags);}, "recv", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags);	
 }
 
 ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen)
 {
-	return do_io(sockfd, recvfrom_f, "recvfrom", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);	
+	return do_io(sockfd, recvfrom_f, nullptr, "recvfrom", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);	
 }
 
 ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags)
 {
-	return do_io(sockfd, recvmsg_f, "recvmsg", sylar::IOManager::READ, SO_RCVTIMEO, msg, flags);	
+	return do_io(sockfd, recvmsg_f, [=](io_uring_sqe* sqe){sylar::IoUring::PrepRecvmsg(sqe, sockfd, msg, flags);}, "recvmsg", sylar::IOManager::READ, SO_RCVTIMEO, msg, flags);	
 }
 
 ssize_t write(int fd, const void *buf, size_t count)
 {
-	return do_io(fd, write_f, "write", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, count);	
+	return do_io(fd, write_f, [=](io_uring_sqe* sqe){sylar::IoUring::PrepSend(sqe, fd, buf, count, 0);}, "write", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, count);	
 }
 
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
 {
-	return do_io(fd, writev_f, "writev", sylar::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);	
+	struct msghdr msg = {};
+	msg.msg_iov = (struct iovec*)iov;
+	msg.msg_iovlen = iovcnt;
+	return do_io(fd, writev_f, [&](io_uring_sqe* sqe){sylar::IoUring::PrepSendmsg(sqe, fd, &msg, 0);}, "writev", sylar::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);	
 }
 
 ssize_t send(int sockfd, const void *buf, size_t len, int flags)
 {
-	return do_io(sockfd, send_f, "send", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags);	
+	return do_io(sockfd, send_f, [=](io_uring_sqe* sqe){sylar::IoUring::PrepSend(sqe, sockfd, buf, len, flags);}, "send", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags);	
 }
 
 ssize_t sendto(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen)
 {
-	return do_io(sockfd, sendto_f, "sendto", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags, dest_addr, addrlen);	
+	return do_io(sockfd, sendto_f, nullptr, "sendto", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags, dest_addr, addrlen);	
 }
 
 ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags)
 {
-	return do_io(sockfd, sendmsg_f, "sendmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, flags);	
+	return do_io(sockfd, sendmsg_f, [=](io_uring_sqe* sqe){sylar::IoUring::PrepSendmsg(sqe, sockfd, msg, flags);}, "sendmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, flags);	
 }
 
 int close(int fd)
@@ -473,7 +618,7 @@ int close(int fd)
 		return close_f(fd);
 	}	
 
-	std::shared_ptr<sylar::FdCtx> ctx = sylar::FdMgr::GetInstance()->get(fd);
+	sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd);
 
 	if(ctx)
 	{
@@ -503,7 +648,7 @@ int fcntl(int fd, int cmd, ... /* arg */ )
             {
                 int arg = va_arg(va, int); // Access the next int argument
                 va_end(va);
-                std::shared_ptr<sylar::FdCtx> ctx = sylar::FdMgr::GetInstance()->get(fd);
+                sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd);
                 if(!ctx || ctx->isClosed() || !ctx->isSocket()) 
                 {
                     return fcntl_f(fd, cmd, arg);
@@ -527,7 +672,7 @@ int fcntl(int fd, int cmd, ... /* arg */ )
             {
                 va_end(va);
                 int arg = fcntl_f(fd, cmd);
-                std::shared_ptr<sylar::FdCtx> ctx = sylar::FdMgr::GetInstance()->get(fd);
+                sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd);
                 if(!ctx || ctx->isClosed() || !ctx->isSocket()) 
                 {
                     return arg;
@@ -613,7 +758,7 @@ int ioctl(int fd, unsigned long request, ...)
     if(FIONBIO == request) //用于设置非阻塞模式的命令
     {
         bool user_nonblock = !!*(int*)arg; //当前 ioctl 调用是为了设置或清除非阻塞模式
-        std::shared_ptr<sylar::FdCtx> ctx = sylar::FdMgr::GetInstance()->get(fd);
+        sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(fd);
         //检查获取的上下文对象是否有效(即 ctx 是否为空)。如果上下文对象无效、文件描述符已关闭或不是一个套接字，则直接调用原始的 ioctl
         if(!ctx || ctx->isClosed() || !ctx->isSocket()) 
         {
@@ -656,13 +801,15 @@ int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t
     {
         if(optname == SO_RCVTIMEO || optname == SO_SNDTIMEO) 
         {
-            std::shared_ptr<sylar::FdCtx> ctx = sylar::FdMgr::GetInstance()->get(sockfd);
+            sylar::FdCtx* ctx = sylar::FdMgr::GetInstance()->get(sockfd);
             if(ctx) 
             {
-                //那么代码会读取传入的 timeval 结构体，将其转化为毫秒数，并调用 ctx->setimeout 方法，记录超时设置
+                //那么代码会读取传入的 timeval 结构体，将其转化为微秒数，并调用 ctx->setimeout 方法，记录超时设置
                 // timeval结构体: 通常用于表示时间间隔，它在Unix系统中非常常见，定义如下:
                 const timeval* v = (const timeval*)optval;
-                ctx->setTimeout(optname, v->tv_sec * 1000 + v->tv_usec / 1000);
+                uint64_t us = v->tv_sec * 1000000 + v->tv_usec;
+                // 与内核一致: 0表示不超时
+                ctx->setTimeout(optname, us ? us : (uint64_t)-1);
             }
         }
     }
@@ -0,0 +1,167 @@
+#include "io_uring_ly.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+
+namespace sylar {
+
+static int io_uring_setup(unsigned entries, io_uring_params* p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+IoUring::~IoUring()
+{
+    if(m_sqes)
+    {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if(m_ringPtr)
+    {
+        munmap(m_ringPtr, m_ringSize);
+    }
+    if(m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+bool IoUring::init(unsigned entries)
+{
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    // 显式指定CQ大小, 不依赖内核的默认值; 调用方按它限制未完成的操作数
+    p.flags = IORING_SETUP_CLAMP | IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 2;
+
+    m_fd = io_uring_setup(entries, &p);
+    if(m_fd < 0)
+    {
+        return false;
+    }
+    // 需要SQ和CQ共用一次mmap(5.4+)
+    if(!(p.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    m_ringSize = std::max(p.sq_off.array + p.sq_entries * sizeof(unsigned), p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+    m_ringPtr = mmap(nullptr, m_ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if(m_ringPtr == MAP_FAILED)
+    {
+        m_ringPtr = nullptr;
+        return false;
+    }
+    m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe*)mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if(m_sqes == MAP_FAILED)
+    {
+        m_sqes = nullptr;
+        return false;
+    }
+
+    char* ring = (char*)m_ringPtr;
+    m_sqHead = (unsigned*)(ring + p.sq_off.head);
+    m_sqTail = (unsigned*)(ring + p.sq_off.tail);
+    m_sqArray = (unsigned*)(ring + p.sq_off.array);
+    m_sqFlags = (unsigned*)(ring + p.sq_off.flags);
+    m_sqMask = *(unsigned*)(ring + p.sq_off.ring_mask);
+    m_sqEntries = p.sq_entries;
+    m_sqeHead = m_sqeTail = *m_sqTail;
+
+    m_cqHead = (unsigned*)(ring + p.cq_off.head);
+    m_cqTail = (unsigned*)(ring + p.cq_off.tail);
+    m_cqMask = *(unsigned*)(ring + p.cq_off.ring_mask);
+    m_cqEntries = p.cq_entries;
+    m_cqes = (io_uring_cqe*)(ring + p.cq_off.cqes);
+    return true;
+}
+
+io_uring_sqe* IoUring::getSqe()
+{
+    // 内核在io_uring_enter中消费SQE并推进head
+    if(m_sqeTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries)
+    {
+        submit();
+        if(m_sqeTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries)
+        {
+            return nullptr;
+        }
+    }
+
+    unsigned index = m_sqeTail & m_sqMask;
+    m_sqArray[index] = index;
+    m_sqeTail++;
+    m_inflight++;
+    io_uring_sqe* sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int IoUring::submit()
+{
+    unsigned count = m_sqeTail - m_sqeHead;
+    if(count == 0)
+    {
+        return 0;
+    }
+
+    // SQE写完后再发布tail
+    __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+
+    int rt = 0;
+    do
+    {
+        rt = io_uring_enter(m_fd, count, 0, 0);
+    } while(rt < 0 && errno == EINTR);
+
+    if(rt < 0)
+    {
+        // EAGAIN/EBUSY -> 未提交的SQE留到下一次
+        return -errno;
+    }
+    m_sqeHead += rt;
+    return rt;
+}
+
+unsigned IoUring::reap(io_uring_cqe* cqes, unsigned count)
+{
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    unsigned n = std::min(tail - head, count);
+    for(unsigned i = 0; i < n; i++)
+    {
+        cqes[i] = m_cqes[(head + i) & m_cqMask];
+    }
+    // 拷贝完成后再归还CQE
+    __atomic_store_n(m_cqHead, head + n, __ATOMIC_RELEASE);
+    m_inflight -= n;
+    return n;
+}
+
+bool IoUring::flushOverflow()
+{
+    if(!(__atomic_load_n(m_sqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW))
+    {
+        return false;
+    }
+    // GETEVENTS且min_complete为0 -> 只把溢出的CQE刷回CQ, 不等待
+    int rt = 0;
+    do
+    {
+        rt = io_uring_enter(m_fd, 0, 0, IORING_ENTER_GETEVENTS);
+    } while(rt < 0 && errno == EINTR);
+    return true;
+}
+
+}
@@ -0,0 +1,128 @@
+#ifndef _IO_URING_LY_H_
+#define _IO_URING_LY_H_
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <cstdint>
+#include <cstring>
+
+namespace sylar {
+
+// io_uring的最小封装: 直接使用系统调用和共享内存环, 不依赖liburing
+// 不是线程安全的, 由调用方加锁
+class IoUring
+{
+public:
+    IoUring() = default;
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // 创建ring, 内核不支持(或被禁止)时返回false
+    // CQ大小为SQ的两倍, 调用方应把未完成的操作数(包括取消请求)限制在getCqEntries()以内
+    bool init(unsigned entries);
+
+    int getFd() const {return m_fd;}
+
+    // 取一个空闲的SQE(已清零), SQ已满时先提交已有的SQE
+    io_uring_sqe* getSqe();
+    // 提交所有取出的SQE, 不等待完成, 返回提交的数量或-errno
+    int submit();
+    // 已取出但还未提交的SQE数量
+    unsigned getUnsubmitted() const {return m_sqeTail - m_sqeHead;}
+
+    // 取出最多count个已完成的CQE, 返回数量
+    unsigned reap(io_uring_cqe* cqes, unsigned count);
+    // CQ满时内核把多出的CQE放在溢出链表上, 需要主动刷回CQ; 有溢出时刷新并返回true
+    bool flushOverflow();
+
+    // 已取出SQE还未取走CQE的操作数(包括取消请求)
+    unsigned getInflight() const {return m_inflight;}
+    unsigned getCqEntries() const {return m_cqEntries;}
+
+public:
+    static void PrepRecv(io_uring_sqe* sqe, int fd, void* buf, size_t len, int flags)
+    {
+        PrepRw(sqe, IORING_OP_RECV, fd, buf, len, 0);
+        sqe->msg_flags = flags;
+    }
+
+    static void PrepSend(io_uring_sqe* sqe, int fd, const void* buf, size_t len, int flags)
+    {
+        PrepRw(sqe, IORING_OP_SEND, fd, buf, len, 0);
+        sqe->msg_flags = flags;
+    }
+
+    static void PrepRecvmsg(io_uring_sqe* sqe, int fd, msghdr* msg, int flags)
+    {
+        PrepRw(sqe, IORING_OP_RECVMSG, fd, msg, 1, 0);
+        sqe->msg_flags = flags;
+    }
+
+    static void PrepSendmsg(io_uring_sqe* sqe, int fd, const msghdr* msg, int flags)
+    {
+        PrepRw(sqe, IORING_OP_SENDMSG, fd, msg, 1, 0);
+        sqe->msg_flags = flags;
+    }
+
+    static void PrepAccept(io_uring_sqe* sqe, int fd, sockaddr* addr, socklen_t* addrlen, int flags)
+    {
+        PrepRw(sqe, IORING_OP_ACCEPT, fd, addr, 0, (uint64_t)addrlen);
+        sqe->accept_flags = flags;
+    }
+
+    static void PrepConnect(io_uring_sqe* sqe, int fd, const sockaddr* addr, socklen_t addrlen)
+    {
+        PrepRw(sqe, IORING_OP_CONNECT, fd, addr, 0, addrlen);
+    }
+
+    // 取消user_data对应的操作, 被取消的操作以-ECANCELED完成
+    static void PrepCancel(io_uring_sqe* sqe, uint64_t user_data)
+    {
+        PrepRw(sqe, IORING_OP_ASYNC_CANCEL, -1, (void*)user_data, 0, 0);
+    }
+
+private:
+    static void PrepRw(io_uring_sqe* sqe, int op, int fd, const void* addr, unsigned len, uint64_t off)
+    {
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = op;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)addr;
+        sqe->len = len;
+        sqe->off = off;
+    }
+
+private:
+    int m_fd = -1;
+
+    // mmap的共享内存
+    void* m_ringPtr = nullptr;
+    size_t m_ringSize = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+
+    // SQ
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned* m_sqArray = nullptr;
+    unsigned* m_sqFlags = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    // [m_sqeHead, m_sqeTail) 已取出还未提交
+    unsigned m_sqeHead = 0;
+    unsigned m_sqeTail = 0;
+
+    // CQ
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    unsigned m_cqEntries = 0;
+    io_uring_cqe* m_cqes = nullptr;
+    unsigned m_inflight = 0;
+};
+
+}
+
+#endif
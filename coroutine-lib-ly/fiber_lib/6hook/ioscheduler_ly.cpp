@@ -1,14 +1,56 @@
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/prctl.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
+#include <algorithm>
 
 #include "ioscheduler_ly.h"
+#include "fd_manager_ly.h"
 
+// -DSYLAR_IOMANAGER_QUIET turns off the idle loop trace, the benchmarks are built with it
+#ifdef SYLAR_IOMANAGER_QUIET
+static bool debug = false;
+#else
 static bool debug = true;
+#endif
 
 namespace sylar {
 
+// epoll data of a ring fd: the tag bit with the worker index, never an FdContext pointer
+static const uint64_t RING_TAG = 1ull << 63;
+// queued SQEs submitted at once without waiting for the worker to go idle
+static const unsigned MAX_QUEUED_IO = 32;
+// high resolution wait: timer slack of this thread already lowered
+static thread_local bool t_highResSlack = false;
+
+// the default 50us slack of the thread would dominate sub-millisecond timeouts
+static void lowerTimerSlack()
+{
+    if(!t_highResSlack)
+    {
+        prctl(PR_SET_TIMERSLACK, 1, 0, 0, 0);
+        t_highResSlack = true;
+    }
+}
+
+// epoll_wait with a nanosecond timeout, ~0ull -> forever
+// called through syscall, glibc before 2.35 has no wrapper
+static int epoll_wait_ns(int epfd, epoll_event* events, int maxevents, uint64_t timeout_ns)
+{
+#ifdef __NR_epoll_pwait2
+    timespec ts;
+    ts.tv_sec = timeout_ns / 1000000000;
+    ts.tv_nsec = timeout_ns % 1000000000;
+    return syscall(__NR_epoll_pwait2, epfd, events, maxevents, timeout_ns == ~0ull ? nullptr : &ts, nullptr, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
 IOManager* IOManager::GetThis()
 {
     return dynamic_cast<IOManager*>(Scheduler::GetThis());
@@ -64,84 +106,103 @@ void IOManager::FdContext::resetEventContext(EventContext &ctx)
     return;
  }
 
-IOManager::IOManager(size_t threads, bool use_caller, const std::string &name):
-Scheduler(threads, use_caller, name), TimerManager()
+int IOManager::createEpoll(int& tickle_fd)
 {
     // create epoll fd
-    m_epfd = epoll_create(5000);
-    assert(m_epfd > 0);
+    int epfd = epoll_create(5000);
+    assert(epfd > 0);
 
-    // create pipe
-    int rt = pipe(m_tickleFds); //创建管道的函数规定了m tickleFds[0]是读端，1是写段
-    assert(!rt);//错误就终止程序
+    // create eventfd, non-blocked -> draining it never blocks the poller
+    tickle_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(tickle_fd >= 0);
 
     // add read event to epoll
-    epoll_event event;
+    epoll_event event = {};
     event.events = EPOLLIN | EPOLLET ; //Edge Triggered，设置标志位，并且采用边缘触发和读事件。
-    event.data.fd = m_tickleFds[0];
-
-    // non-blocked 若读取端无数据，read() 立即返回 -1，并设置 errno 为 EAGAIN 或 EWOULDBLOCK
-    rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK);
-    assert(!rt);
+    event.data.fd = tickle_fd;
 
-    // 将读取端添加到epoll中, 读端怎么从管道里读数据呢
     // 触发后在idle中读取
-    rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
+    int rt = epoll_ctl(epfd, EPOLL_CTL_ADD, tickle_fd, &event);
     assert(!rt);
-
-    contextResize(32);
-
-    start();
+    return epfd;
 }
 
-IOManager::~IOManager()
+IOManager::IOManager(size_t threads, bool use_caller, const std::string &name, bool sharded, Backend backend):
+Scheduler(threads, use_caller, name), TimerManager(threads), m_sharded(sharded), m_backend(backend)
 {
-    stop();// 关闭scheduler类中的线程池，让任务全部执行完后线程安全退出
-    close(m_epfd);
-    close(m_tickleFds[0]);
-    close(m_tickleFds[1]);
-    // 将fdcontext文件描述符一个个关闭
-    for(size_t i = 0; i < m_fdContexts.size(); ++i)
+    m_epfd = createEpoll(m_tickleFd);
+
+    m_parkedWorkers.resize(getWorkerCount());
+    for(auto& parked : m_parkedWorkers)
     {
-        if(m_fdContexts[i])
+        parked.reset(new ParkedWorker());
+        if(m_sharded)
         {
-            delete m_fdContexts[i];
+            parked->epfd = createEpoll(parked->tickleFd);
         }
     }
+
+    if(m_backend == IO_URING)
+    {
+        static const unsigned RING_ENTRIES = 256;
+        for(auto& parked : m_parkedWorkers)
+        {
+            parked->ring.reset(new IoUring());
+            if(!parked->ring->init(RING_ENTRIES))
+            {
+                std::cerr << "IOManager: io_uring unavailable (" << strerror(errno) << "), fall back to epoll" << std::endl;
+                m_backend = EPOLL;
+                break;
+            }
+        }
+    }
+    if(m_backend == IO_URING)
+    {
+        // completions make the ring fd readable -> wakes whoever polls the epoll instance it is registered on
+        for(size_t i = 0; i < m_parkedWorkers.size(); i++)
+        {
+            ParkedWorker& parked = *m_parkedWorkers[i];
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.u64 = RING_TAG | i;
+            int rt = epoll_ctl(m_sharded ? parked.epfd : m_epfd, EPOLL_CTL_ADD, parked.ring->getFd(), &event);
+            assert(!rt);
+        }
+    }
+    else
+    {
+        for(auto& parked : m_parkedWorkers)
+        {
+            parked->ring.reset();
+        }
+    }
+
+    start();
 }
 
-// no lock
-void IOManager::contextResize(size_t size) 
+IOManager::~IOManager()
 {
-    m_fdContexts.resize(size);
-
-    for(size_t i = 0; i < m_fdContexts.size(); ++i)
+    stop();// 关闭scheduler类中的线程池，让任务全部执行完后线程安全退出
+    close(m_epfd);
+    close(m_tickleFd);
+    for(auto& parked : m_parkedWorkers)
     {
-        if(m_fdContexts[i] == nullptr)
+        if(parked->epfd >= 0)
         {
-            m_fdContexts[i] = new FdContext();
-            m_fdContexts[i]->fd = i; // fdcontext的fd是索引
+            close(parked->epfd);
+            close(parked->tickleFd);
         }
     }
+    // fd contexts are released with m_fdContexts
 }
 
 int IOManager::addEvent(int fd, Event event, std::function<void()> cb)
 {
-    // attemp to find FdContext 
-    FdContext* fd_ctx = nullptr;
-
-    std::shared_lock<std::shared_mutex> read_lock(m_mutex);
-    if((int)m_fdContexts.size() > fd)
-    {
-        fd_ctx = m_fdContexts[fd];
-        read_lock.unlock();
-    }
-    else
+    // allocated on first touch and never moved -> no lock
+    FdContext* fd_ctx = m_fdContexts.get(fd);
+    if(!fd_ctx)
     {
-        read_lock.unlock();
-        std::unique_lock<std::shared_mutex> write_lock(m_mutex);
-        contextResize(fd * 1.5); // 扩容
-        fd_ctx = m_fdContexts[fd];
+        return -1;
     }
 
     std::lock_guard<std::mutex> lock(fd_ctx->mutex);
@@ -152,13 +213,25 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb)
         return -1; // event already exists
     }
 
+    if(m_backend == EPOLL_PERSISTENT)
+    {
+        return addPersistentEvent(fd_ctx, event, cb);
+    }
+
     // add the new event
     int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD; // 如果fd_ctx->events不为0，说明已经有事件了，就修改，否则就添加
     epoll_event epevent;
     epevent.events = EPOLLET | fd_ctx->events | event;
     epevent.data.ptr = fd_ctx;
 
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+    // sharded -> register on the shard of the current worker
+    if(m_sharded && op == EPOLL_CTL_ADD)
+    {
+        int worker = GetWorkerIndex();
+        fd_ctx->shard = (Scheduler::GetThis() == this && worker >= 0) ? worker : m_nextShard++ % getWorkerCount();
+    }
+
+    int rt = epoll_ctl(getEpollFd(fd_ctx), op, fd, &epevent);
     if(rt)
     {
         std::cerr << "addEvent::epoll_ctl failed: " << strerror(errno) << std::endl; 
@@ -186,20 +259,101 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb)
     return 0; // success
 }
 
-bool IOManager::delEvent(int fd, Event event)
+// fd_ctx->mutex held
+int IOManager::addPersistentEvent(FdContext* fd_ctx, Event event, std::function<void()>& cb)
 {
-    // attemp to find FdContext 
-    FdContext *fd_ctx = nullptr;
+    int worker = (Scheduler::GetThis() == this) ? GetWorkerIndex() : -1;
+
+    // the fd number was closed without the hooked close (hook disabled, raw syscall) and reused:
+    // the kernel dropped the old registration together with the old file -> register the new file again
+    FdCtx* ctx = FdMgr::GetInstance()->get(fd_ctx->fd);
+    uint32_t generation = ctx ? ctx->getGeneration() : 0;
+    if(fd_ctx->registered && fd_ctx->generation != generation)
+    {
+        fd_ctx->registered = false;
+        fd_ctx->ready = NONE;
+        fd_ctx->shard = -1;
+    }
 
-    std::shared_lock<std::shared_mutex> read_lock(m_mutex);
-    if((int)m_fdContexts.size() > fd)
+    // sharded -> the waiting fiber moved to another worker, move the fd along so that its events stay local
+    if(m_sharded && fd_ctx->registered && fd_ctx->events == NONE && worker >= 0 && worker != fd_ctx->shard)
+    {
+        epoll_event epevent;
+        epevent.events = 0;
+        epevent.data.ptr = fd_ctx;
+        int rt = epoll_ctl(getEpollFd(fd_ctx), EPOLL_CTL_DEL, fd_ctx->fd, &epevent);
+        if(rt)
+        {
+            std::cerr << "addEvent::epoll_ctl failed: " << strerror(errno) << std::endl; 
+        }
+        else
+        {
+            fd_ctx->registered = false;
+        }
+    }
+
+    // registered once, kept until cancelAll
+    if(!fd_ctx->registered)
+    {
+        if(m_sharded)
+        {
+            fd_ctx->shard = worker >= 0 ? worker : m_nextShard++ % getWorkerCount();
+        }
+
+        epoll_event epevent;
+        epevent.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        epevent.data.ptr = fd_ctx;
+        int rt = epoll_ctl(getEpollFd(fd_ctx), EPOLL_CTL_ADD, fd_ctx->fd, &epevent);
+        if(rt && errno == EEXIST)
+        {
+            // the same file is still registered (its fd context was renewed without a close)
+            rt = epoll_ctl(getEpollFd(fd_ctx), EPOLL_CTL_MOD, fd_ctx->fd, &epevent);
+        }
+        if(rt)
+        {
+            std::cerr << "addEvent::epoll_ctl failed: " << strerror(errno) << std::endl; 
+            fd_ctx->shard = -1;
+            return -1;
+        }
+        fd_ctx->registered = true;
+        fd_ctx->generation = generation;
+        // a fresh registration reports the current readiness -> nothing is cached yet
+        fd_ctx->ready = NONE;
+    }
+
+    ++m_pendingEventCount;
+
+    fd_ctx->events = (Event)(fd_ctx->events | event);
+
+    FdContext::EventContext& event_ctx = fd_ctx->getEventContext(event);
+    assert(!event_ctx.scheduler && !event_ctx.fiber && !event_ctx.cb);
+    event_ctx.scheduler = Scheduler::GetThis();
+    if(cb)
     {
-        fd_ctx = m_fdContexts[fd];
-        read_lock.unlock();
+        event_ctx.cb.swap(cb);
     }
     else
     {
-        read_lock.unlock();
+        event_ctx.fiber = Fiber::GetThis();
+        assert(event_ctx.fiber->getState() == Fiber::RUNNING);
+    }
+
+    // the edge came after the caller saw EAGAIN -> no new edge will follow, trigger right away
+    // a stale one only costs a retry that sees EAGAIN again
+    if(fd_ctx->ready & event)
+    {
+        fd_ctx->ready = (Event)(fd_ctx->ready & ~event);
+        fd_ctx->triggerEvent(event);
+        --m_pendingEventCount;
+    }
+    return 0;
+}
+
+bool IOManager::delEvent(int fd, Event event)
+{
+    FdContext* fd_ctx = m_fdContexts.find(fd);
+    if(!fd_ctx)
+    {
         return false;
     }
 
@@ -213,16 +367,24 @@ bool IOManager::delEvent(int fd, Event event)
 
     // delete the event
     Event new_events = (Event)(fd_ctx->events & ~event);
-    int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL; // 如果还有其他事件，就修改，否则就删除
-    epoll_event epevent;
-    epevent.events = EPOLLET | new_events;
-    epevent.data.ptr = fd_ctx;
-
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt)
+    // persistent registration -> only the waiter goes away
+    if(m_backend != EPOLL_PERSISTENT)
     {
-        std::cerr << "delEvent::epoll_ctl failed: " << strerror(errno) << std::endl; 
-        return false;
+        int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL; // 如果还有其他事件，就修改，否则就删除
+        epoll_event epevent;
+        epevent.events = EPOLLET | new_events;
+        epevent.data.ptr = fd_ctx;
+
+        int rt = epoll_ctl(getEpollFd(fd_ctx), op, fd, &epevent);
+        if(rt)
+        {
+            std::cerr << "delEvent::epoll_ctl failed: " << strerror(errno) << std::endl; 
+            return false;
+        }
+        if(op == EPOLL_CTL_DEL)
+        {
+            fd_ctx->shard = -1;
+        }
     }
 
     --m_pendingEventCount;
@@ -237,25 +399,196 @@ bool IOManager::delEvent(int fd, Event event)
     return true; // success
 }
 
-bool IOManager::cancelEvent(int fd, Event event)
+int IOManager::submitIo(int fd, Event event, const io_uring_sqe& sqe)
 {
-    // attemp to find FdContext 
-    FdContext *fd_ctx = nullptr;
+    assert(m_backend == IO_URING);
 
-    std::shared_lock<std::shared_mutex> read_lock(m_mutex);
-    if((int)m_fdContexts.size() > fd)
+    // allocated on first touch and never moved -> no lock
+    FdContext* fd_ctx = m_fdContexts.get(fd);
+    if(!fd_ctx)
     {
-        fd_ctx = m_fdContexts[fd];
-        read_lock.unlock();
+        return -EBADF;
     }
-    else
+
+    // the fiber stays suspended until the completion -> the request can live on its stack
+    IoRequest req;
+    req.fdCtx = fd_ctx;
+    req.event = event;
+    int worker = GetWorkerIndex();
+    req.ring = (Scheduler::GetThis() == this && worker >= 0) ? worker : 0;
+    req.fiber = Fiber::GetThis();
+    assert(req.fiber->getState() == Fiber::RUNNING);
+    // the kernel writes to the request and the buffers while the fiber is suspended
+    // -> a shared stack is overwritten by other fibers meanwhile, wait with epoll instead
+    if(req.fiber->isSharedStack())
+    {
+        return -EAGAIN;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(fd_ctx->mutex);
+
+        FdContext::EventContext& event_ctx = fd_ctx->getEventContext(event);
+        // another fiber is waiting in the same direction
+        if(event_ctx.io)
+        {
+            return -EBUSY;
+        }
+
+        ParkedWorker& parked = *m_parkedWorkers[req.ring];
+        std::lock_guard<std::mutex> ring_lock(parked.ringMutex);
+        // at most half of the CQ -> the completions and their cancels never overflow it
+        if(parked.ring->getInflight() >= parked.ring->getCqEntries() / 2)
+        {
+            return -EAGAIN;
+        }
+        io_uring_sqe* slot = parked.ring->getSqe();
+        if(!slot)
+        {
+            return -EAGAIN;
+        }
+        *slot = sqe;
+        slot->user_data = (uint64_t)&req;
+        event_ctx.io = &req;
+        ++m_pendingEventCount;
+
+        // submitted when a worker goes idle -> the operations of the tasks run in between share one io_uring_enter
+        if(parked.ring->getUnsubmitted() >= MAX_QUEUED_IO)
+        {
+            parked.ring->submit();
+        }
+        parked.ringQueued = parked.ring->getUnsubmitted() + parked.pendingCancels.size();
+    }
+
+    // resumed by reapIo()
+    Fiber::GetThis()->yield();
+    return req.result;
+}
+
+void IOManager::flushIo()
+{
+    for(auto& parked : m_parkedWorkers)
+    {
+        if(parked->ringQueued == 0)
+        {
+            continue;
+        }
+        std::lock_guard<std::mutex> ring_lock(parked->ringMutex);
+        // getSqe() submits the queued SQEs to make room
+        while(!parked->pendingCancels.empty())
+        {
+            io_uring_sqe* sqe = parked->ring->getSqe();
+            if(!sqe)
+            {
+                break;
+            }
+            IoUring::PrepCancel(sqe, (uint64_t)parked->pendingCancels.back());
+            parked->pendingCancels.pop_back();
+        }
+        // EAGAIN/EBUSY -> the SQEs stay queued and go out with the next flushIo()
+        parked->ring->submit();
+        parked->ringQueued = parked->ring->getUnsubmitted() + parked->pendingCancels.size();
+    }
+}
+
+void IOManager::reapIo(int worker)
+{
+    static const unsigned MAX_CQES = 256;
+    io_uring_cqe cqes[MAX_CQES];
+
+    ParkedWorker& parked = *m_parkedWorkers[worker];
+    while(true)
+    {
+        // copy out first -> fd_ctx->mutex is never taken under the ring lock
+        unsigned n = 0;
+        {
+            std::lock_guard<std::mutex> ring_lock(parked.ringMutex);
+            n = parked.ring->reap(cqes, MAX_CQES);
+        }
+        if(n == 0)
+        {
+            // the completions that did not fit are on the overflow list of the kernel -> move them into the CQ and reap again
+            std::lock_guard<std::mutex> ring_lock(parked.ringMutex);
+            if(!parked.ring->flushOverflow())
+            {
+                break;
+            }
+            continue;
+        }
+
+        for(unsigned i = 0; i < n; ++i)
+        {
+            // completion of a cancel request
+            if(cqes[i].user_data == 0)
+            {
+                continue;
+            }
+
+            IoRequest* req = (IoRequest*)cqes[i].user_data;
+            std::shared_ptr<Fiber> fiber;
+            {
+                std::lock_guard<std::mutex> lock(req->fdCtx->mutex);
+                req->fdCtx->getEventContext(req->event).io = nullptr;
+                req->result = cqes[i].res;
+                // a cancel still waiting for the SQ must not outlive req -> its address is reused by the next request
+                // cancelIo() runs under fd_ctx->mutex, so ringQueued is up to date here
+                if(parked.ringQueued)
+                {
+                    std::lock_guard<std::mutex> ring_lock(parked.ringMutex);
+                    auto it = std::find(parked.pendingCancels.begin(), parked.pendingCancels.end(), req);
+                    if(it != parked.pendingCancels.end())
+                    {
+                        parked.pendingCancels.erase(it);
+                        parked.ringQueued = parked.ring->getUnsubmitted() + parked.pendingCancels.size();
+                    }
+                }
+                fiber.swap(req->fiber);
+            }
+            // req is gone once the fiber runs
+            scheduleLock(&fiber);
+            --m_pendingEventCount;
+        }
+    }
+}
+
+void IOManager::cancelIo(IoRequest* req)
+{
+    ParkedWorker& parked = *m_parkedWorkers[req->ring];
+    std::lock_guard<std::mutex> ring_lock(parked.ringMutex);
+    io_uring_sqe* sqe = parked.ring->getSqe();
+    if(!sqe)
+    {
+        // the kernel takes no more SQEs for now (CQ overflow) -> sent by the next flushIo()
+        // the fiber stays suspended until the cancel or the operation completes
+        parked.pendingCancels.push_back(req);
+        parked.ringQueued = parked.ring->getUnsubmitted() + parked.pendingCancels.size();
+        return;
+    }
+    IoUring::PrepCancel(sqe, (uint64_t)req);
+    // submitted right away, the queued operations go along with it
+    // EAGAIN/EBUSY -> the cancel stays queued and goes out with the next flushIo()
+    parked.ring->submit();
+    parked.ringQueued = parked.ring->getUnsubmitted() + parked.pendingCancels.size();
+}
+
+bool IOManager::cancelEvent(int fd, Event event)
+{
+    FdContext* fd_ctx = m_fdContexts.find(fd);
+    if(!fd_ctx)
     {
-        read_lock.unlock();
         return false;
     }
 
     std::lock_guard<std::mutex> lock(fd_ctx->mutex);
 
+    // io_uring operation in flight -> its completion resumes the fiber
+    FdContext::EventContext& event_ctx = fd_ctx->getEventContext(event);
+    if(event_ctx.io)
+    {
+        cancelIo(event_ctx.io);
+        return true;
+    }
+
     // the event doesn't exist
     if(!(fd_ctx->events & event))
     {
@@ -264,16 +597,24 @@ bool IOManager::cancelEvent(int fd, Event event)
 
     // delete the event
     Event new_events = (Event)(fd_ctx->events & ~event);
-    int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL; // 如果还有其他事件，就修改，否则就删除
-    epoll_event epevent;
-    epevent.events = EPOLLET | new_events;
-    epevent.data.ptr = fd_ctx;
-
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt)
+    // persistent registration -> only the waiter goes away
+    if(m_backend != EPOLL_PERSISTENT)
     {
-        std::cerr << "cancelEvent::epoll_ctl failed: " << strerror(errno) << std::endl; 
-        return false;
+        int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL; // 如果还有其他事件，就修改，否则就删除
+        epoll_event epevent;
+        epevent.events = EPOLLET | new_events;
+        epevent.data.ptr = fd_ctx;
+
+        int rt = epoll_ctl(getEpollFd(fd_ctx), op, fd, &epevent);
+        if(rt)
+        {
+            std::cerr << "cancelEvent::epoll_ctl failed: " << strerror(errno) << std::endl; 
+            return false;
+        }
+        if(op == EPOLL_CTL_DEL)
+        {
+            fd_ctx->shard = -1;
+        }
     }
 
     --m_pendingEventCount;
@@ -286,27 +627,30 @@ bool IOManager::cancelEvent(int fd, Event event)
 
 bool IOManager::cancelAll(int fd)
 {
-    // attemp to find FdContext 
-    FdContext *fd_ctx = nullptr;
-
-    std::shared_lock<std::shared_mutex> read_lock(m_mutex);
-    if ((int)m_fdContexts.size() > fd) 
-    {
-        fd_ctx = m_fdContexts[fd];
-        read_lock.unlock();
-    }
-    else 
+    FdContext* fd_ctx = m_fdContexts.find(fd);
+    if(!fd_ctx)
     {
-        read_lock.unlock();
         return false;
     }
 
     std::lock_guard<std::mutex> lock(fd_ctx->mutex);
+
+    // io_uring operations in flight
+    bool cancelled = false;
+    for (Event event : {READ, WRITE}) 
+    {
+        FdContext::EventContext& event_ctx = fd_ctx->getEventContext(event);
+        if (event_ctx.io) 
+        {
+            cancelIo(event_ctx.io);
+            cancelled = true;
+        }
+    }
     
     // none of events exist
-    if (!fd_ctx->events) 
+    if (!fd_ctx->events && !fd_ctx->registered) 
     {
-        return false;
+        return cancelled;
     }
 
     // delete all events
@@ -315,12 +659,16 @@ bool IOManager::cancelAll(int fd)
     epevent.events   = 0;
     epevent.data.ptr = fd_ctx;
 
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if (rt) 
+    int rt = epoll_ctl(getEpollFd(fd_ctx), op, fd, &epevent);
+    // persistent registration of a file already closed behind our back -> the kernel dropped it, nothing to delete
+    if (rt && !(errno == ENOENT && fd_ctx->registered && !fd_ctx->events)) 
     {
         std::cerr << "IOManager::epoll_ctl failed: " << strerror(errno) << std::endl; 
         return false;
     }
+    fd_ctx->shard = -1;
+    fd_ctx->registered = false;
+    fd_ctx->ready = NONE;
 
     // update fdcontext, event context and trigger
     for (Event event : {READ, WRITE}) 
@@ -337,24 +685,152 @@ bool IOManager::cancelAll(int fd)
     return true;
 }
 
+int IOManager::getEpollFd(FdContext* fd_ctx) const
+{
+    if(m_sharded)
+    {
+        assert(fd_ctx->shard >= 0);
+        return m_parkedWorkers[fd_ctx->shard]->epfd;
+    }
+    return m_epfd;
+}
+
 void IOManager::tickle()
 {
-    // no idle threads
-    if(!hasIdleThreads()) 
+    // no idle threads, or a woken worker is still looking for tasks and will wake the next one
+    if(!hasIdleThreads() || hasSearchingThreads()) 
+    {
+        return;
+    }
+
+    if(wakeParked(-1, true))
+    {
+        return;
+    }
+
+    // nobody parked -> the poller, once per epoll_wait
+    if(m_poller != -1 && !m_pollerWoken.exchange(true))
+    {
+        wakePoller();
+    }
+}
+
+void IOManager::tickleWorker(int worker)
+{
+    if(wakeParked(worker, false))
     {
         return;
     }
+    if(m_poller == worker)
+    {
+        wakePoller();
+    }
+    // otherwise it is running and checks its mailbox before going idle again
+}
+
+void IOManager::wakePoller()
+{
+    uint64_t one = 1;
+    int rt = write(m_tickleFd, &one, sizeof(one));
+    assert(rt == sizeof(one));
+}
+
+bool IOManager::wakeParked(int worker, bool searching)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_idleMutex);
+        if(m_idleWorkers.empty())
+        {
+            return false;
+        }
+
+        if(worker == -1)
+        {
+            worker = m_idleWorkers.back();
+            m_idleWorkers.pop_back();
+        }
+        else
+        {
+            if(!m_parkedWorkers[worker]->parked)
+            {
+                return false;
+            }
+            m_idleWorkers.erase(std::find(m_idleWorkers.begin(), m_idleWorkers.end(), worker));
+        }
+        m_parkedWorkers[worker]->parked = false;
+    }
+
+    if(searching)
+    {
+        markSearching(worker);
+    }
+
+    ParkedWorker& parked = *m_parkedWorkers[worker];
+    if(m_sharded)
+    {
+        // blocked in epoll_wait on its own shard
+        uint64_t one = 1;
+        int rt = write(parked.tickleFd, &one, sizeof(one));
+        assert(rt == sizeof(one));
+    }
+    else
+    {
+        parked.sem.signal();
+    }
+    return true;
+}
 
-    // write to the write end of the pipe
-    int rt = write(m_tickleFds[1], "T", 1);
-    assert(rt == 1);
+void IOManager::pushIdle(int worker)
+{
+    std::lock_guard<std::mutex> lock(m_idleMutex);
+    m_parkedWorkers[worker]->parked = true;
+    m_idleWorkers.push_back(worker);
+}
+
+void IOManager::popIdle(int worker)
+{
+    // woken concurrently -> a signal is left behind and the next wait returns at once
+    std::lock_guard<std::mutex> lock(m_idleMutex);
+    ParkedWorker& self = *m_parkedWorkers[worker];
+    if(self.parked)
+    {
+        self.parked = false;
+        m_idleWorkers.erase(std::find(m_idleWorkers.begin(), m_idleWorkers.end(), worker));
+    }
+}
+
+void IOManager::park(int worker)
+{
+    static const uint64_t MAX_PARK_TIME = 5000;
+    pushIdle(worker);
+
+    // recheck after registering -> a task pushed or the poller role released before that is not missed
+    bool wait = !hasPendingTask() && m_poller != -1 && !stopping();
+    if(wait)
+    {
+        // the poller does not fire the timers of this worker -> wake up for the first of them
+        uint64_t timeout = std::min(getNextTimerNs(), MAX_PARK_TIME * 1000000);
+        if(m_highResTimer)
+        {
+            lowerTimerSlack();
+        }
+        else
+        {
+            // round up like epoll_wait
+            timeout = (timeout + 999999) / 1000000 * 1000000;
+        }
+        m_parkedWorkers[worker]->sem.waitFor(std::chrono::nanoseconds(timeout));
+    }
+
+    // not woken by anyone (recheck or timeout) -> unregister
+    popIdle(worker);
 }
 
 bool IOManager::stopping()
 {
-    uint64_t timeout = getNextTimer();
-    // no timers left and no pending events left with the Scheduler::stopping()
-    return timeout == ~0ull && m_pendingEventCount == 0 && Scheduler::stopping();
+    // no timers left on any shard and no pending events left with the Scheduler::stopping()
+    // checked after hasTimer(): a timer that has left its shard is counted in m_expiringTimers until its callback is a task
+    return !hasTimer() && m_expiringTimers == 0 && m_pendingEventCount == 0 && Scheduler::stopping();
 }
 
 void IOManager::idle()
@@ -372,15 +848,60 @@ void IOManager::idle()
             break;
         }
 
+        // submit the operations queued since the last time, one io_uring_enter per ring
+        if(m_backend == IO_URING)
+        {
+            flushIo();
+        }
+
+        int worker = GetWorkerIndex();
+        int epfd = m_epfd;
+        int tickle_fd = m_tickleFd;
+        if(m_sharded)
+        {
+            // poll the own shard, woken through its eventfd
+            epfd = m_parkedWorkers[worker]->epfd;
+            tickle_fd = m_parkedWorkers[worker]->tickleFd;
+            pushIdle(worker);
+        }
+        else
+        {
+            // only one worker blocks in epoll_wait, the others park until woken
+            int no_poller = -1;
+            if(!m_poller.compare_exchange_strong(no_poller, worker))
+            {
+                park(worker);
+                scheduleExpiredTimers();
+                Fiber::GetThis()->yield();
+                continue;
+            }
+            m_pollerWoken = false;
+        }
+
         // blocked at epoll_wait
+        // recheck after registering -> a task pushed before that did not wake us
         int rt = 0;
-        while(true) // 超时或有事件触发，跳出while
+        while(!hasPendingTask() && !(m_sharded && stopping())) // 超时或有事件触发，跳出while
         {
             static const uint64_t MAX_TIMEOUT = 5000;
-            uint64_t next_timeout = getNextTimer();
-            next_timeout = std::min(next_timeout, MAX_TIMEOUT);
+            if(m_highResTimer)
+            {
+                lowerTimerSlack();
+                uint64_t next_timeout = std::min(getNextTimerNs(), MAX_TIMEOUT * 1000000);
+                rt = epoll_wait_ns(epfd, events.get(), MAX_EVNETS, next_timeout);
+                if(rt < 0 && errno == ENOSYS)
+                {
+                    m_highResTimer = false;
+                    continue;
+                }
+            }
+            else
+            {
+                uint64_t next_timeout = getNextTimer();
+                next_timeout = std::min(next_timeout, MAX_TIMEOUT);
 
-            rt = epoll_wait(m_epfd, events.get(), MAX_EVNETS, (int)next_timeout);
+                rt = epoll_wait(epfd, events.get(), MAX_EVNETS, (int)next_timeout);
+            }
             // EINTR -> retry
             if(rt < 0 && errno == EINTR) 
             {
@@ -393,31 +914,37 @@ void IOManager::idle()
                 break;
             }
         }
+        if(m_sharded)
+        {
+            popIdle(worker);
+        }
+        else
+        {
+            m_poller = -1;
+        }
 
         // collect all timers overdue
         // epoll_wait 会返回 0，表示超时且无事件发生
-        std::vector<std::function<void()>> cbs;
-        listExpiredCb(cbs);
-        if(!cbs.empty()) 
-        {
-            for(const auto& cb : cbs) 
-            {
-                scheduleLock(cb);
-            }
-            cbs.clear();
-        }
+        scheduleExpiredTimers();
 
         // collect all events ready
         for (int i = 0; i < rt; ++i) 
         {
             epoll_event& event = events[i];
 
+            // completions on a ring
+            if (event.data.u64 & RING_TAG) 
+            {
+                reapIo(event.data.u64 & ~RING_TAG);
+                continue;
+            }
+
             // tickle event
-            if (event.data.fd == m_tickleFds[0]) 
+            if (event.data.fd == tickle_fd) 
             {
-                uint8_t dummy[256];
+                uint64_t dummy;
                 // edge triggered -> exhaust
-                while (read(m_tickleFds[0], dummy, sizeof(dummy)) > 0);
+                while (read(tickle_fd, &dummy, sizeof(dummy)) > 0);
                 continue;
             }
 
@@ -425,11 +952,24 @@ void IOManager::idle()
             FdContext *fd_ctx = (FdContext *)event.data.ptr;
             std::lock_guard<std::mutex> lock(fd_ctx->mutex);
 
+            // sharded -> stale event of an fd that has been moved to another shard
+            if (m_sharded && fd_ctx->shard != worker) 
+            {
+                continue;
+            }
+
+            // persistent registration -> the fd was closed and the fd number reused since this event
+            if (m_backend == EPOLL_PERSISTENT && !fd_ctx->registered) 
+            {
+                continue;
+            }
+
             // convert EPOLLERR or EPOLLHUP to -> read or write event
             // 当检测到 EPOLLERR（文件描述符错误）或 EPOLLHUP（连接挂断）时，代码会强制将当前文件描述符（fd）的 ​​可读（EPOLLIN）和可写（EPOLLOUT）事件​​ 添加到 event.events 中
             if (event.events & (EPOLLERR | EPOLLHUP)) 
             {
-                event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
+                // persistent -> both directions, the next waiter sees the error as well
+                event.events |= (EPOLLIN | EPOLLOUT) & (m_backend == EPOLL_PERSISTENT ? (READ | WRITE) : fd_ctx->events);
             }
             // events happening during this turn of epoll_wait
             int real_events = NONE;
@@ -441,21 +981,39 @@ void IOManager::idle()
             {
                 real_events |= WRITE;
             }
-            if ((fd_ctx->events & real_events) == NONE) 
+
+            if (m_backend == EPOLL_PERSISTENT) 
             {
-                continue;
+                // stays registered -> remember the readiness nobody waits for, the next addEvent consumes it
+                fd_ctx->ready = (Event)(fd_ctx->ready | (real_events & ~fd_ctx->events));
+                real_events &= fd_ctx->events;
+                if (real_events == NONE) 
+                {
+                    continue;
+                }
             }
-
-            // delete the events that have already happened
-            int left_events = (fd_ctx->events & ~real_events);
-            int op          = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-            event.events    = EPOLLET | left_events;
-
-            int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
-            if (rt2) 
+            else
             {
-                std::cerr << "idle::epoll_ctl failed: " << strerror(errno) << std::endl; 
-                continue;
+                if ((fd_ctx->events & real_events) == NONE) 
+                {
+                    continue;
+                }
+
+                // delete the events that have already happened
+                int left_events = (fd_ctx->events & ~real_events);
+                int op          = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+                event.events    = EPOLLET | left_events;
+
+                int rt2 = epoll_ctl(epfd, op, fd_ctx->fd, &event);
+                if (rt2) 
+                {
+                    std::cerr << "idle::epoll_ctl failed: " << strerror(errno) << std::endl; 
+                    continue;
+                }
+                if(op == EPOLL_CTL_DEL)
+                {
+                    fd_ctx->shard = -1;
+                }
             }
 
             // schedule callback and update fdcontext and event context
@@ -470,14 +1028,50 @@ void IOManager::idle()
                 --m_pendingEventCount;
             }
         } // end for
+
+        // about to run tasks -> hand the poller role to a parked worker so that I/O is still watched
+        // a worker already woken for the tasks takes the role if it finds none
+        if(!m_sharded && hasPendingTask() && !hasSearchingThreads())
+        {
+            wakeParked(-1, false);
+        }
         Fiber::GetThis()->yield();
     }
 }
 
-void IOManager::onTimerInsertedAtFront()
+void IOManager::scheduleExpiredTimers()
+{
+    // between listExpiredCb and scheduleInline the callbacks are neither timers nor tasks
+    // without the count another idle worker sees stopping() and exits with work still coming
+    ++m_expiringTimers;
+    std::vector<std::function<void()>> cbs;
+    listExpiredCb(cbs);
+    // timer callbacks are usually short and non-blocking -> run them inline
+    for(auto& cb : cbs) 
+    {
+        scheduleInline(std::move(cb));
+    }
+    --m_expiringTimers;
+}
+
+void IOManager::onTimerInsertedAtFront(int shard)
+{
+    // added by another thread -> only the owner waits for the timers of the shard, make it recompute the timeout
+    // the owner is parked, polling, or running and recomputes before it waits again
+    tickleWorker(shard);
+}
+
+int IOManager::getTimerShard()
+{
+    return Scheduler::GetThis() == this ? GetWorkerIndex() : -1;
+}
+
+int IOManager::pickTimerShard()
 {
-    // tickle the IOManager to wake up the idle fiber
-    tickle();
+    // use_caller -> worker 0 only runs inside stop(), keep timers of other threads off its shard
+    size_t count = getWorkerCount();
+    size_t first = (isUseCaller() && count > 1) ? 1 : 0;
+    return first + m_nextTimerShard++ % (count - first);
 }
 
 
@@ -2,6 +2,8 @@
 #define __SYLAR_IOMANAGER_LY_H__
 
 #include "scheduler_ly.h"
+#include "io_uring_ly.h"
+#include "fd_table_ly.h"
 #include "timer_ly.h"
 
 namespace sylar {
@@ -21,7 +23,20 @@ public:
         WRITE = 0x4
     };
 
+    enum Backend
+    {
+        // wait for readiness with epoll, then retry the operation
+        EPOLL,
+        // like EPOLL, but an fd is registered for EPOLLIN|EPOLLOUT|EPOLLET once and stays registered until cancelAll (close)
+        // readiness nobody waits for is cached on the FdContext, no epoll_ctl per wait
+        EPOLL_PERSISTENT,
+        // submit the operation to io_uring, the waiting fiber is resumed with its result
+        IO_URING
+    };
+
 private:
+    struct IoRequest;
+
     struct FdContext
     {
         struct EventContext
@@ -32,6 +47,8 @@ private:
             std::shared_ptr<Fiber> fiber;
             // callback function
             std::function<void()> cb;
+            // io_uring operation in flight, independent of the epoll event
+            IoRequest* io = nullptr;
         };
         
         // read event context
@@ -42,17 +59,30 @@ private:
         int fd = 0;
         // events registered
         Event events = NONE;
+        // sharded mode: worker whose epoll instance the fd is registered on, -1 if not registered
+        int shard = -1;
+        // EPOLL_PERSISTENT: registered on epoll
+        bool registered = false;
+        // EPOLL_PERSISTENT: FdCtx generation of the file that was registered
+        uint32_t generation = 0;
+        // EPOLL_PERSISTENT: readiness reported while nobody was waiting, consumed by the next addEvent
+        Event ready = NONE;
         std::mutex mutex;
 
         EventContext& getEventContext(Event event);
         void resetEventContext(EventContext &ctx);
         void triggerEvent(Event event);
 
+        explicit FdContext(int fd_) : fd(fd_) {}
+
     };
     
 
 public:
-    IOManager(size_t threads = 1, bool use_caller = true, const std::string &name = "IOManager");
+    // sharded -> one epoll instance per worker, an fd is registered on the shard of the worker that first waits on it
+    // and its ready events are scheduled onto that worker's local queue
+    // backend -> IO_URING falls back to EPOLL if the kernel does not support io_uring
+    IOManager(size_t threads = 1, bool use_caller = true, const std::string &name = "IOManager", bool sharded = false, Backend backend = EPOLL);
     ~IOManager();
     
     // add one event at a time
@@ -64,29 +94,129 @@ public:
     // delete all events and trigger its callback
     bool cancelAll(int fd);
 
+    // io_uring backend: submit the operation on fd to the ring of the current worker and yield until it completes
+    // event -> direction, cancelEvent/cancelAll cancel it
+    // return the result of the operation, -errno on failure, -ECANCELED if cancelled
+    // -EAGAIN -> not submitted (queue full or a shared-stack fiber), wait with epoll instead
+    int submitIo(int fd, Event event, const io_uring_sqe& sqe);
+
     static IOManager* GetThis();
 
+    bool isSharded() const {return m_sharded;}
+
+    Backend getBackend() const {return m_backend;}
+
+    // high resolution -> idle workers wait for the next timer with epoll_pwait2 and a nanosecond timeout
+    // instead of epoll_wait with the timeout rounded up to milliseconds, and with a minimal thread timer slack
+    // falls back to epoll_wait if the kernel does not support epoll_pwait2 (before 5.11)
+    void setHighResTimer(bool v) {m_highResTimer = v;}
+    bool isHighResTimer() const {return m_highResTimer;}
+
 protected:
     void tickle() override;
 
+    void tickleWorker(int worker) override;
+
     bool stopping() override;
 
     void idle() override;
 
-    void onTimerInsertedAtFront() override;
+    void onTimerInsertedAtFront(int shard) override;
 
-    void contextResize(size_t size);
+    // every worker owns the timer shard with its index
+    int getTimerShard() override;
+
+    int pickTimerShard() override;
+
+private:
+    // shared mode: idle workers take turns, one poller blocks in epoll_wait, the others park on their own semaphore
+    // sharded mode: every idle worker blocks in epoll_wait on its own shard
+    struct ParkedWorker
+    {
+        Semaphore sem;
+        // in m_idleWorkers, protected by m_idleMutex
+        bool parked = false;
+        // sharded mode: epoll instance of the shard and the eventfd to wake it up
+        int epfd = -1;
+        int tickleFd = -1;
+
+        // io_uring backend: ring of the worker, submitted in batches when a worker goes idle
+        std::unique_ptr<IoUring> ring;
+        std::mutex ringMutex;
+        // cancels that found the SQ full, sent by the next flushIo()
+        std::vector<IoRequest*> pendingCancels;
+        // SQEs queued and not yet submitted plus the pending cancels, read without the lock
+        std::atomic<unsigned> ringQueued = {0};
+    };
+
+    // io_uring backend: one operation in flight, lives on the stack of the waiting fiber
+    struct IoRequest
+    {
+        FdContext* fdCtx = nullptr;
+        Event event = NONE;
+        // ring the operation was submitted to
+        int ring = 0;
+        std::shared_ptr<Fiber> fiber;
+        int result = 0;
+    };
+
+    // create an epoll instance with a wakeup eventfd registered
+    static int createEpoll(int& tickle_fd);
+    // epoll instance the fd is registered on
+    int getEpollFd(FdContext* fd_ctx) const;
+
+    // push the worker onto the idle stack
+    void pushIdle(int worker);
+    // remove the worker from the idle stack unless a waker already did
+    void popIdle(int worker);
+    // park the current worker until it is woken or the poller role is free
+    void park(int worker);
+    // wake a parked worker, -1 -> the most recently parked one
+    // searching -> it is woken to look for tasks rather than to take over polling
+    bool wakeParked(int worker, bool searching);
+    // interrupt epoll_wait of the poller
+    void wakePoller();
+
+    // schedule the callbacks of the expired timers on the shard of the current worker
+    void scheduleExpiredTimers();
+
+    // EPOLL_PERSISTENT: register the waiter, the fd itself only on its first wait
+    int addPersistentEvent(FdContext* fd_ctx, Event event, std::function<void()>& cb);
+
+    // io_uring backend: submit the operations queued on all rings
+    void flushIo();
+    // io_uring backend: resume the fibers of the completed operations on the ring of the worker
+    void reapIo(int worker);
+    // io_uring backend: cancel the operation, the fiber is resumed by its completion
+    void cancelIo(IoRequest* req);
 
 private:
     int m_epfd = 0;
-    // fd[0] read，fd[1] write
-    int m_tickleFds[2];
+    // eventfd to wake up the poller
+    int m_tickleFd = -1;
+    // worker blocked in epoll_wait, -1 if none
+    std::atomic<int> m_poller = {-1};
+    // the poller has been woken for new tasks since it took the role
+    std::atomic<bool> m_pollerWoken = {false};
+
+    bool m_sharded = false;
+    Backend m_backend = EPOLL;
+    std::atomic<bool> m_highResTimer = {false};
+    // sharded mode: shard for fds first waited on by a non-worker thread
+    std::atomic<size_t> m_nextShard = {0};
+    // timer shard for timers added by a non-worker thread
+    std::atomic<size_t> m_nextTimerShard = {0};
+
+    std::vector<std::unique_ptr<ParkedWorker>> m_parkedWorkers;
+    std::mutex m_idleMutex;
+    // parked workers, the most recently parked one on top
+    std::vector<int> m_idleWorkers;
 
     std::atomic<size_t> m_pendingEventCount = {0};
-    std::shared_mutex m_mutex;
-
+    // expired timers taken off their shard and not yet scheduled
+    std::atomic<size_t> m_expiringTimers = {0};
     // store fdcontexts for each fd
-    std::vector<FdContext *> m_fdContexts;
+    FdTable<FdContext> m_fdContexts;
 };
 
 
@@ -8,6 +8,10 @@ namespace sylar{
 
 // 正在运行的调度器
 static thread_local Scheduler* t_scheduler = nullptr;
+// 当前线程在调度器中的工作线程编号, 非工作线程为-1
+static thread_local int t_worker = -1;
+// 选择窃取对象的随机数
+static thread_local uint32_t t_rand = 0;
 
 // 获取正在运行的调度器
 Scheduler* Scheduler::GetThis()
@@ -20,6 +24,37 @@ void Scheduler::SetThis()
     t_scheduler = this;
 }
 
+// 内联任务的执行载体: 依次运行本线程取到的内联任务, 任务结束后yield回调度协程等待下一个
+// 任务在hook中阻塞时, 载体协程已被事件/定时器持有 -> 调度协程放弃它(提升为普通协程), 任务结束后载体直接退出
+struct InlineCarrier
+{
+    std::function<void()> cb;
+    // 正在执行任务
+    bool busy = false;
+    // 已提升为普通协程
+    bool promoted = false;
+    // 调度线程退出
+    bool stop = false;
+};
+
+static void InlineCarrierMain(InlineCarrier* carrier)
+{
+    // 裸指针 -> 挂起期间不持有自身的引用
+    Fiber* self = Fiber::GetThis().get();
+    while(!carrier->stop)
+    {
+        carrier->busy = true;
+        carrier->cb();
+        carrier->cb = nullptr;
+        carrier->busy = false;
+        if(carrier->promoted)
+        {
+            return;
+        }
+        self->yield();
+    }
+}
+
 Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name):
 m_useCaller(use_caller), m_name(name)
 {
@@ -29,6 +64,12 @@ m_useCaller(use_caller), m_name(name)
 
     Thread::SetName(m_name);
 
+    m_workers.resize(threads);
+    for(auto& worker : m_workers)
+    {
+        worker.reset(new Worker());
+    }
+
     // 使用主线程当作工作线程
     if(use_caller)
     {
@@ -38,7 +79,7 @@ m_useCaller(use_caller), m_name(name)
         Fiber::GetThis();
 
         // 创建调度协程 , false -> 该调度协程退出后将返回主协程
-        m_schedulerFiber.reset(new Fiber(std::bind(&Scheduler::run, this), 0, false));
+        m_schedulerFiber.reset(new Fiber(std::bind(&Scheduler::runWorker, this, 0), 0, false));
         Fiber::SetSchedulerFiber(m_schedulerFiber.get());
 
         m_rootThread = Thread::GetThreadId();
@@ -74,13 +115,250 @@ void Scheduler::start()
     m_threads.resize(m_threadCount);
     for(size_t i = 0; i < m_threadCount; i++)
     {
-        m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(i)));
+        int worker = m_useCaller ? i + 1 : i;
+        m_threads[i].reset(new Thread(std::bind(&Scheduler::runWorker, this, worker), m_name + "_" + std::to_string(i)));
         m_threadIds.push_back(m_threads[i]->getId());
     }
 
     if(debug) std::cout << "Scheduler::start() success\n";
 }
 
+void Scheduler::pushTask(ScheduleTask& task)
+{
+    if(!task.fiber && !task.cb)
+    {
+        return;
+    }
+
+    // 先计数再入队 -> stopping()不会在入队过程中误判为没有任务
+    // empty ->  all thread is idle -> need to be waken up
+    bool need_tickle = m_taskCount.fetch_add(1) == 0;
+
+    int target = task.thread == -1 ? -1 : findWorker(task.thread);
+    if(task.thread == -1 && t_scheduler == this && t_worker >= 0)
+    {
+        // 工作线程提交 -> 本地队列, 无锁
+        Worker& worker = *m_workers[t_worker];
+        TaskNode* node = allocNode(worker);
+        node->task = std::move(task);
+        worker.queue.push(node);
+    }
+    else if(target >= 0)
+    {
+        // 指定线程 -> 目标线程的信箱
+        // 信箱由空变为非空时只唤醒目标线程, 非空说明目标线程还没取完, 会再回来取
+        Worker& worker = *m_workers[target];
+        bool was_empty;
+        {
+            std::lock_guard<std::mutex> lock(worker.mailboxMutex);
+            worker.mailbox.push_back(std::move(task));
+            was_empty = worker.mailboxCount++ == 0;
+            m_mailboxTaskCount++;
+        }
+        if(was_empty && (target != t_worker || t_scheduler != this))
+        {
+            tickleWorker(target);
+        }
+        return;
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+        m_globalTaskCount++;
+    }
+
+    if(need_tickle) // 若队列为空唤醒线程 
+    {
+        tickle();
+    }
+}
+
+bool Scheduler::takeGlobalTask(ScheduleTask& task, int thread_id)
+{
+    if(m_globalTaskCount == 0)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(auto it = m_tasks.begin(); it != m_tasks.end(); it++)
+    {
+        // 跳过需要由其他线程处理的任务
+        if(it->thread != -1 && it->thread != thread_id)
+        {
+            continue;
+        }
+
+        assert(it->fiber || it->cb);
+        task = std::move(*it);
+        m_tasks.erase(it);
+        m_globalTaskCount--;
+        return true;
+    }
+    return false;
+}
+
+int Scheduler::findWorker(int thread_id) const
+{
+    if(t_scheduler == this && t_worker >= 0 && m_workers[t_worker]->threadId == thread_id)
+    {
+        return t_worker;
+    }
+    for(size_t i = 0; i < m_workers.size(); i++)
+    {
+        if(m_workers[i]->threadId == thread_id)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool Scheduler::takeTask(ScheduleTask& task, int thread_id, uint32_t tick)
+{
+    // 信箱
+    if(t_worker >= 0 && m_workers[t_worker]->mailboxCount > 0)
+    {
+        Worker& worker = *m_workers[t_worker];
+        std::lock_guard<std::mutex> lock(worker.mailboxMutex);
+        if(!worker.mailbox.empty())
+        {
+            task = std::move(worker.mailbox.front());
+            worker.mailbox.pop_front();
+            worker.mailboxCount--;
+            m_mailboxTaskCount--;
+            return true;
+        }
+    }
+
+    bool global_first = tick % 61 == 0;
+    if(global_first && takeGlobalTask(task, thread_id))
+    {
+        return true;
+    }
+
+    // 本地队列
+    TaskNode* local = nullptr;
+    if(t_worker >= 0)
+    {
+        local = m_workers[t_worker]->queue.steal();
+    }
+
+    if(!local && !global_first && takeGlobalTask(task, thread_id))
+    {
+        return true;
+    }
+
+    // 从随机位置开始依次窃取其他工作线程的任务
+    size_t n = m_workers.size();
+    t_rand ^= t_rand << 13;
+    t_rand ^= t_rand >> 17;
+    t_rand ^= t_rand << 5;
+    for(size_t i = 0; !local && i < n; i++)
+    {
+        size_t victim = (t_rand + i) % n;
+        if((int)victim != t_worker)
+        {
+            local = m_workers[victim]->queue.steal();
+        }
+    }
+
+    if(!local)
+    {
+        return false;
+    }
+    task = std::move(local->task);
+    freeNode(local);
+    return true;
+}
+
+Scheduler::TaskNode* Scheduler::allocNode(Worker& worker)
+{
+    if(!worker.freeNodes)
+    {
+        worker.freeNodes = worker.returnedNodes.exchange(nullptr, std::memory_order_acquire);
+    }
+    if(!worker.freeNodes)
+    {
+        // 按块分配, 之后一直复用, 节点数不超过本地队列的最高水位
+        static const size_t NODE_CHUNK = 64;
+        TaskNode* chunk = new TaskNode[NODE_CHUNK];
+        worker.nodeChunks.emplace_back(chunk);
+        for(size_t i = 0; i < NODE_CHUNK; i++)
+        {
+            chunk[i].owner = &worker;
+            chunk[i].next = i + 1 < NODE_CHUNK ? &chunk[i + 1] : nullptr;
+        }
+        worker.freeNodes = chunk;
+    }
+    TaskNode* node = worker.freeNodes;
+    worker.freeNodes = node->next;
+    return node;
+}
+
+void Scheduler::freeNode(TaskNode* node)
+{
+    // 先释放任务持有的协程和回调
+    node->task.reset();
+    Worker& owner = *node->owner;
+    if(t_scheduler == this && t_worker >= 0 && m_workers[t_worker].get() == &owner)
+    {
+        node->next = owner.freeNodes;
+        owner.freeNodes = node;
+        return;
+    }
+    // 只有push和整体取走 -> 没有ABA问题
+    TaskNode* head = owner.returnedNodes.load(std::memory_order_relaxed);
+    do
+    {
+        node->next = head;
+    } while(!owner.returnedNodes.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+}
+
+int Scheduler::GetWorkerIndex()
+{
+    return t_worker;
+}
+
+bool Scheduler::hasPendingTask() const
+{
+    if(t_scheduler == this && t_worker >= 0 && m_workers[t_worker]->mailboxCount > 0)
+    {
+        return true;
+    }
+    return m_taskCount > m_mailboxTaskCount;
+}
+
+bool Scheduler::markSearching(int worker)
+{
+    if(m_workers[worker]->searching.exchange(true))
+    {
+        return false;
+    }
+    m_searchingCount++;
+    return true;
+}
+
+void Scheduler::clearSearching()
+{
+    if(m_workers[t_worker]->searching.exchange(false))
+    {
+        m_searchingCount--;
+    }
+}
+
+void Scheduler::runWorker(int worker)
+{
+    t_worker = worker;
+    t_rand = Thread::GetThreadId() | 1;
+    m_workers[worker]->threadId = Thread::GetThreadId();
+    run();
+    clearSearching();
+    m_workers[worker]->threadId = -1;
+    t_worker = -1;
+}
+
 void Scheduler::run()
 {
     int thread_id = Thread::GetThreadId();
@@ -98,38 +376,27 @@ void Scheduler::run()
 
     std::shared_ptr<Fiber> idle_fiber = std::make_shared<Fiber>(std::bind(&Scheduler::idle, this));
 
+    // 内联任务的载体协程, 按需创建
+    std::shared_ptr<InlineCarrier> carrier;
+    std::shared_ptr<Fiber> carrier_fiber;
+
     ScheduleTask task;
+    uint32_t tick = 0;
 
     while(true)
     {
         task.reset();
-        bool tickle_me = false;
 
+        // 1 取出任务 先计活跃线程再减任务数 -> stopping()不会误判
+        if(takeTask(task, thread_id, ++tick))
         {
-            std::lock_guard<std::mutex> lock(m_mutex);
-
-            // 1 遍历任务队列
-            auto it = m_tasks.begin();
-            while(it != m_tasks.end())
-            {
-                if(it->thread != -1 && it->thread != thread_id) // 筛选出​​需要由特定线程处理且当前线程不匹配的任务
-                {
-                    it++;
-                    tickle_me = true;
-                    continue;
-                }
-
-                // 2 取出任务
-                assert(it->fiber||it->cb);
-                task = *it;
-                m_tasks.erase(it);
-                m_activeThreadCount++;
-                break;
-            }
-            tickle_me = tickle_me || (it != m_tasks.end());
+            m_activeThreadCount++;
+            m_taskCount--;
+            clearSearching();
         }
 
-        if(tickle_me) tickle();
+        // 2 还有其他线程可以处理的任务 -> 唤醒其他线程
+        if(m_taskCount > m_mailboxTaskCount) tickle();
 
         // 3 执行任务
         if(task.fiber)
@@ -142,11 +409,42 @@ void Scheduler::run()
                 }
             }
             m_activeThreadCount--;
+            // 已结束且无其他引用 -> 回收到协程池
+            FiberPool::Release(task.fiber);
             task.reset();
         }
+        else if(task.cb && task.inlineRun)
+        {
+            if(!carrier_fiber)
+            {
+                carrier = std::make_shared<InlineCarrier>();
+                carrier_fiber = FiberPool::Acquire([carrier](){InlineCarrierMain(carrier.get());});
+            }
+            carrier->cb.swap(task.cb);
+            {
+                std::lock_guard<std::mutex> lock(carrier_fiber->m_mutex);
+                carrier_fiber->resume();
+                // 任务未结束 -> 阻塞在hook中 -> 提升为普通协程
+                // 持有协程锁时标记, 其他线程恢复该协程时一定能看到
+                if(carrier->busy)
+                {
+                    carrier->promoted = true;
+                }
+            }
+            m_activeThreadCount--;
+            task.reset();
+            if(carrier->promoted)
+            {
+                carrier.reset();
+                carrier_fiber.reset();
+            }
+        }
         else if(task.cb)
         {
-            std::shared_ptr<Fiber> cb_fiber = std::make_shared<Fiber>(task.cb);
+            // 从协程池中取出协程, 避免每个任务都分配一次协程栈
+            // 共享栈协程没有独立栈, 直接新建
+            std::shared_ptr<Fiber> cb_fiber = m_sharedStack ? std::make_shared<Fiber>(task.cb, 0, true, true) : FiberPool::Acquire(task.cb, task.stacksize);
+            cb_fiber->setTag(task.tag);
             {
                 std::lock_guard<std::mutex> lock(cb_fiber->m_mutex);
                 if(cb_fiber->getState() != Fiber::TERM)
@@ -156,6 +454,7 @@ void Scheduler::run()
                 m_activeThreadCount--;
                 task.reset();
             }
+            FiberPool::Release(cb_fiber);
         }
         // 4 无任务 -> 执行空闲协程
         else
@@ -163,9 +462,25 @@ void Scheduler::run()
             // 系统关闭 -> idle协程将从死循环跳出并结束 -> 此时的idle协程状态为TERM -> 再次进入将跳出循环并退出run()
             if(idle_fiber->getState() == Fiber::TERM)
             {
+                // 结束载体协程, 回收到协程池
+                if(carrier_fiber)
+                {
+                    carrier->stop = true;
+                    {
+                        std::lock_guard<std::mutex> lock(carrier_fiber->m_mutex);
+                        carrier_fiber->resume();
+                    }
+                    FiberPool::Release(carrier_fiber);
+                }
+                // 唤醒仍在空闲中的线程, 让它们也检查到退出条件
+                for(size_t i = 0; i < m_workers.size(); i++)
+                {
+                    tickleWorker(i);
+                }
                 if(debug) std::cout << "Schedule::run() ends in thread: " << thread_id << std::endl;
                 break;
             }
+            clearSearching();
             m_idleThreadCount++;
             idle_fiber->resume();
             m_idleThreadCount--;
@@ -193,14 +508,10 @@ void Scheduler::stop()
         assert(GetThis() != this);
     }
 
-    for(size_t i = 0; i < m_threadCount; i++)
+    // 逐个唤醒工作线程
+    for(size_t i = 0; i < m_workers.size(); i++)
     {
-        tickle();
-    }
-
-    if(m_schedulerFiber)
-    {
-        tickle();
+        tickleWorker(i);
     }
 
     if(m_schedulerFiber)
@@ -240,8 +551,7 @@ void Scheduler::idle()
 // 判断调度器是否退出
 bool Scheduler::stopping()
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    return m_stopping && m_tasks.empty() && m_activeThreadCount == 0;
+    return m_stopping && m_taskCount == 0 && m_activeThreadCount == 0;
 }
 
 
@@ -3,7 +3,12 @@
 
 #include "thread_ly.h"
 #include "fiber_ly.h"
+#include "fiber_pool_ly.h"
+#include "stack_profiler_ly.h"
+#include "work_queue_ly.h"
 
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <vector>
 
@@ -18,6 +23,11 @@ public:
 
     const std::string& getName() const {return m_name;}
 
+    // 共享栈模式: 回调任务运行在共享栈协程上, 挂起时只保存已用的栈 -> 适合大量空闲连接
+    // 需要汇编上下文切换, -DSYLAR_FIBER_UCONTEXT编译时忽略
+    void setSharedStack(bool v) {m_sharedStack = v;}
+    bool isSharedStack() const {return m_sharedStack;}
+
 public:
     // 获取正在运行的调度器
     static Scheduler* GetThis();
@@ -28,26 +38,33 @@ protected:
 
 public:
     // 添加任务到任务队列 FiberOrCb是调度任务类型，可以是协程或者函数
+    // tag: 回调任务的栈使用统计标签(需指向静态存储, 按指针区分), 为空时使用回调函数的类型名
+    //      函数指针和std::bind的类型名不区分调用点, 栈用量不同的这类任务应显式传入tag
     template <class FiberOrCb>
-    void scheduleLock(FiberOrCb fc, int thread = -1)
+    void scheduleLock(FiberOrCb fc, int thread = -1, const char* tag = nullptr)
     {   
-        bool need_tickle;// 用于标记任务队列是否为空，从而判断是否要唤醒线程
+        ScheduleTask task(fc, thread);// 创建任务对象
+        if(task.cb)
         {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            // empty ->  all thread is idle -> need to be waken up
-            need_tickle = m_tasks.empty();
-
-            ScheduleTask task(fc, thread);// 创建任务对象
-            if(task.fiber || task.cb)       
+            task.tag = tag ? tag : StackProfiler::GetTag(task.cb);
+            // 自动栈大小 -> 按该标签的历史最高水位选择栈大小档位
+            if(StackProfiler::IsAutoSize())
             {
-                m_tasks.push_back(task);
-            }     
+                task.stacksize = StackProfiler::GetStackSize(task.tag);
+            }
         }
 
-        if(need_tickle) // 若队列为空唤醒线程 
-        {
-            tickle();
-        }
+        pushTask(task);
+    }
+
+    // 添加内联任务: 适合不会阻塞的短回调(如定时器回调)
+    // 在当前线程复用的载体协程上运行到结束, 不为每个任务取协程、重置上下文
+    // 若任务在hook中阻塞, 载体协程就地提升为普通协程, 之后的内联任务改用新的载体
+    void scheduleInline(std::function<void()> cb, int thread = -1)
+    {
+        ScheduleTask task(&cb, thread);
+        task.inlineRun = true;
+        pushTask(task);
     }
 
 	// 启动线程池 
@@ -62,6 +79,12 @@ protected:
     // 线程函数
     virtual void run();
 
+    // 工作线程入口: 记录工作线程编号后进入run()
+    void runWorker(int worker);
+
+    // 唤醒指定的工作线程, 默认唤醒任意线程
+    virtual void tickleWorker(int /*worker*/) {tickle();}
+
     // 空闲协程函数， 无任务时，执行idle协程
     virtual void idle();
 
@@ -71,6 +94,22 @@ protected:
     // 返回是否有空闲线程
     // 具体来说，当调度协程进入idle时，空闲线程数+1；从idle协程返回时，空闲线程数-1
     bool hasIdleThreads() {return m_idleThreadCount > 0;}
+    size_t getIdleThreadCount() const {return m_idleThreadCount;}
+
+    // 当前线程的工作线程编号, 非工作线程返回-1
+    static int GetWorkerIndex();
+    size_t getWorkerCount() const {return m_workers.size();}
+    // 主线程是否用作0号工作线程, 它只在stop()中运行调度
+    bool isUseCaller() const {return m_useCaller;}
+
+    // 是否有当前线程可以取的任务: 本地/全局队列或自己的信箱
+    bool hasPendingTask() const;
+
+    // 唤醒线程前将其标记为"正在找任务", 已标记返回false
+    // 被唤醒的线程取到任务或重新进入idle时清除标记
+    // 已有线程在找任务时不必再唤醒其他线程, 由它取到任务后继续唤醒下一个
+    bool markSearching(int worker);
+    bool hasSearchingThreads() const {return m_searchingCount > 0;}
 
 private:
     // 任务
@@ -79,6 +118,9 @@ private:
         std::shared_ptr<Fiber> fiber;
         std::function<void()> cb;
         int thread; // 指定任务需要运行的线程id
+        size_t stacksize = 0; // 回调任务的栈大小, 0为默认大小
+        const char* tag = nullptr; // 回调任务的栈使用统计标签
+        bool inlineRun = false; // 内联任务, 在载体协程上运行
 
         ScheduleTask()
         {
@@ -90,14 +132,14 @@ private:
         ScheduleTask(std::shared_ptr<Fiber> f, int thr)
         {
             fiber = f;
-            thread = thr;
+            thread = bindThread(thr);
         }
 
         ScheduleTask(std::shared_ptr<Fiber>* f, int thr)
         {
             // f 是一个指向 std::shared_ptr<Fiber> 的指针，即 shared_ptr 的指针。
             fiber.swap(*f); // 通过 swap 转移所有权
-            thread = thr;
+            thread = bindThread(thr);
         }
 
         ScheduleTask(std::function<void()> f, int thr)
@@ -117,16 +159,91 @@ private:
             fiber = nullptr;
             cb = nullptr;
             thread = -1;
+            stacksize = 0;
+            tag = nullptr;
+            inlineRun = false;
         }
+
+        // 共享栈协程只能回到绑定的线程上运行
+        int bindThread(int thr) const
+        {
+            if(thr == -1 && fiber && fiber->isSharedStack())
+            {
+                return fiber->getBoundThread();
+            }
+            return thr;
+        }
+    };
+
+    struct Worker;
+
+    // 本地队列的任务节点: 由所属线程按块分配, 取走任务的线程还给所属线程 -> 入队出队不经过malloc
+    struct TaskNode
+    {
+        ScheduleTask task;
+        Worker* owner = nullptr;
+        TaskNode* next = nullptr;
     };
+
+    // 工作线程的调度状态
+    struct Worker
+    {
+        // 本地任务队列
+        WorkStealingQueue<TaskNode> queue;
+        // 空闲节点, 只有所属线程访问
+        TaskNode* freeNodes = nullptr;
+        // 其他线程还回的节点, 所属线程取空闲节点时整个取走
+        std::atomic<TaskNode*> returnedNodes = {nullptr};
+        // 分配过的节点块, 随Worker释放
+        std::vector<std::unique_ptr<TaskNode[]>> nodeChunks;
+        // 线程id, 线程开始运行前为-1
+        std::atomic<int> threadId = {-1};
+        // 指定由该线程处理的任务
+        std::mutex mailboxMutex;
+        std::deque<ScheduleTask> mailbox;
+        std::atomic<size_t> mailboxCount = {0};
+        // 被唤醒后还没有取到任务
+        std::atomic<bool> searching = {false};
+    };
+
+    void clearSearching();
+
+    // 取一个空闲节点, 只能由工作线程为自己的本地队列调用
+    TaskNode* allocNode(Worker& worker);
+    // 节点的任务已取走 -> 还给所属线程
+    void freeNode(TaskNode* node);
+
+    // 任务入队, 所有队列由空变为非空时唤醒线程
+    // 工作线程提交的任务进入自己的本地队列, 指定线程的任务进入目标线程的信箱并只唤醒该线程
+    // 其他线程提交的任务以及目标线程尚未运行的任务进入全局队列
+    void pushTask(ScheduleTask& task);
+
+    // 线程id -> 工作线程编号, 不是工作线程返回-1
+    int findWorker(int thread_id) const;
+
+    // 取任务: 信箱 -> 本地队列 -> 全局队列 -> 随机窃取其他工作线程的本地队列
+    // tick: 调度循环计数, 每61次先查全局队列, 避免本地队列一直有任务时全局队列饿死
+    bool takeTask(ScheduleTask& task, int thread_id, uint32_t tick);
+    bool takeGlobalTask(ScheduleTask& task, int thread_id);
+
 private:
     std::string m_name;
-    // 互斥锁 -> 保护任务队列
+    // 互斥锁 -> 保护全局任务队列和线程池
 	std::mutex m_mutex;
     // 线程池
     std::vector<std::shared_ptr<Thread>> m_threads;
-    // 任务队列
-    std::vector<ScheduleTask> m_tasks;
+    // 全局任务队列
+    std::deque<ScheduleTask> m_tasks;
+    // 全局队列中的任务数, 为0时取任务不加锁
+    std::atomic<size_t> m_globalTaskCount = {0};
+    // 工作线程, 下标为工作线程编号
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    // 所有队列中的任务总数
+    std::atomic<size_t> m_taskCount = {0};
+    // 所有信箱中的任务数, 这些任务不需要唤醒其他线程
+    std::atomic<size_t> m_mailboxTaskCount = {0};
+    // 正在找任务的线程数
+    std::atomic<size_t> m_searchingCount = {0};
     // 存储工作线程的线程id
     std::vector<int> m_threadIds;
     // 需要额外创建的线程数
@@ -143,7 +260,9 @@ private:
     // 如果是 -> 记录主线程的线程id
     int m_rootThread = -1;
     // 是否正在关闭
-    bool m_stopping = false;
+    std::atomic<bool> m_stopping = {false};
+    // 回调任务是否使用共享栈协程
+    bool m_sharedStack = false;
 };
 
 
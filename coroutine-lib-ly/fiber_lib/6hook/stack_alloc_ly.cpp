@@ -0,0 +1,79 @@
+#include "stack_alloc_ly.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static bool debug = false;
+
+namespace sylar {
+
+static std::atomic<StackAllocator::Backend> s_default_backend{StackAllocator::MMAP};
+
+static size_t GetPageSize()
+{
+    static size_t s_page_size = sysconf(_SC_PAGESIZE);
+    return s_page_size;
+}
+
+// 向上取整到页大小
+static size_t RoundToPage(size_t size)
+{
+    size_t page = GetPageSize();
+    return (size + page - 1) & ~(page - 1);
+}
+
+void* StackAllocator::Alloc(size_t size, Backend& backend)
+{
+    if(backend == MMAP)
+    {
+        size_t page = GetPageSize();
+        size_t len = RoundToPage(size) + page;
+        // MAP_NORESERVE: 不预留swap, 只有被访问的页才会分配物理内存
+        void* base = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        if(base != MAP_FAILED)
+        {
+            // 栈向低地址增长 -> 最低一页作为保护页
+            if(mprotect(base, page, PROT_NONE) == 0)
+            {
+                return (char*)base + page;
+            }
+            munmap(base, len);
+        }
+        if(debug) std::cerr << "StackAllocator::Alloc mmap failed: " << strerror(errno) << ", fallback to malloc" << std::endl;
+        backend = MALLOC;
+    }
+    return malloc(size);
+}
+
+void StackAllocator::Dealloc(void* stack, size_t size, Backend backend)
+{
+    if(!stack)
+    {
+        return;
+    }
+    if(backend == MMAP)
+    {
+        size_t page = GetPageSize();
+        munmap((char*)stack - page, RoundToPage(size) + page);
+    }
+    else
+    {
+        free(stack);
+    }
+}
+
+void StackAllocator::SetDefaultBackend(Backend backend)
+{
+    s_default_backend = backend;
+}
+
+StackAllocator::Backend StackAllocator::GetDefaultBackend()
+{
+    return s_default_backend;
+}
+
+}
@@ -0,0 +1,35 @@
+#ifndef _STACK_ALLOC_LY_H_
+#define _STACK_ALLOC_LY_H_
+
+#include <cstddef>
+
+namespace sylar {
+
+// 协程栈分配器
+// MALLOC: 直接malloc, 没有溢出保护
+// MMAP:   mmap匿名映射 + 最低地址一页PROT_NONE保护页
+//         物理页按需分配, 协程只为实际用到的栈页付出RSS; 栈溢出触发SIGSEGV而不是踩坏相邻内存
+//         注意每个栈占用两个VMA, 大量协程时需要调大 vm.max_map_count
+class StackAllocator
+{
+public:
+    enum Backend
+    {
+        MALLOC,
+        MMAP
+    };
+
+public:
+    // 分配size字节的栈, 返回栈的最低可用地址
+    // MMAP失败(如超过vm.max_map_count)时退回MALLOC, 实际使用的后端写回backend
+    static void* Alloc(size_t size, Backend& backend);
+    static void Dealloc(void* stack, size_t size, Backend backend);
+
+    // 新建协程使用的默认后端
+    static void SetDefaultBackend(Backend backend);
+    static Backend GetDefaultBackend();
+};
+
+}
+
+#endif
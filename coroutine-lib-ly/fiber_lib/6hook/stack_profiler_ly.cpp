@@ -0,0 +1,203 @@
+#include "stack_profiler_ly.h"
+#include "fiber_ly.h"
+
+#include <atomic>
+#include <cxxabi.h>
+#include <cstdlib>
+#include <map>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace sylar {
+
+// 哨兵值
+static const uint64_t STACK_CANARY = 0xCDCDCDCDCDCDCDCDull;
+
+// 栈大小档位
+static const size_t STACK_SIZE_CLASSES[] = {16 * 1024, 32 * 1024, 64 * 1024, Fiber::DEFAULT_STACK_SIZE, 256 * 1024, 512 * 1024};
+
+static std::atomic<bool> s_enabled{false};
+static std::atomic<bool> s_auto_size{false};
+static std::atomic<size_t> s_margin_percent{25};
+static std::atomic<size_t> s_margin_bytes{8192};
+
+static const char* const UNTAGGED = "<untagged>";
+
+struct StackProfileData
+{
+    std::shared_mutex mutex;
+    // 按标签指针查找: 标签指向静态存储, 查找时不构造std::string
+    std::unordered_map<const char*, StackProfiler::Entry> entries;
+    // 任一标签的栈大小档位变化、修改余量或清空时加1, 使各线程的档位缓存失效
+    std::atomic<uint64_t> version{0};
+};
+
+static StackProfileData& GetData()
+{
+    static StackProfileData* s_data = new StackProfileData();
+    return *s_data;
+}
+
+void StackProfiler::SetEnabled(bool v)
+{
+    s_enabled = v;
+}
+
+bool StackProfiler::IsEnabled()
+{
+    return s_enabled.load(std::memory_order_relaxed);
+}
+
+void StackProfiler::SetAutoSize(bool v, size_t margin_percent, size_t margin_bytes)
+{
+    s_margin_percent = margin_percent;
+    s_margin_bytes = margin_bytes;
+    s_auto_size = v;
+    GetData().version++;
+}
+
+bool StackProfiler::IsAutoSize()
+{
+    return s_auto_size.load(std::memory_order_relaxed);
+}
+
+void StackProfiler::Paint(void* stack, size_t size)
+{
+    uint64_t* p = (uint64_t*)stack;
+    uint64_t* end = p + size / sizeof(uint64_t);
+    while(p < end)
+    {
+        *p++ = STACK_CANARY;
+    }
+}
+
+size_t StackProfiler::Measure(void* stack, size_t size)
+{
+    // 栈向低地址增长 -> 从栈底向上找到第一个被改写的位置
+    uint64_t* p = (uint64_t*)stack;
+    uint64_t* end = p + size / sizeof(uint64_t);
+    while(p < end && *p == STACK_CANARY)
+    {
+        p++;
+    }
+    return (char*)stack + size - (char*)p;
+}
+
+bool StackProfiler::Get(const char* tag, Entry& entry)
+{
+    StackProfileData& data = GetData();
+    std::shared_lock<std::shared_mutex> read_lock(data.mutex);
+    auto it = data.entries.find(tag ? tag : UNTAGGED);
+    if(it == data.entries.end())
+    {
+        return false;
+    }
+    entry = it->second;
+    return true;
+}
+
+// 最高水位加上安全余量后所在的档位
+static size_t GetSizeClass(size_t max_used)
+{
+    size_t want = max_used * (100 + s_margin_percent) / 100 + s_margin_bytes;
+    for(size_t size : STACK_SIZE_CLASSES)
+    {
+        if(want <= size)
+        {
+            return size;
+        }
+    }
+    return STACK_SIZE_CLASSES[sizeof(STACK_SIZE_CLASSES) / sizeof(STACK_SIZE_CLASSES[0]) - 1];
+}
+
+void StackProfiler::Record(const char* tag, size_t used)
+{
+    StackProfileData& data = GetData();
+    std::unique_lock<std::shared_mutex> write_lock(data.mutex);
+    Entry& entry = data.entries[tag ? tag : UNTAGGED];
+    size_t old_class = entry.count ? GetSizeClass(entry.maxUsed) : 0;
+    entry.count++;
+    entry.totalUsed += used;
+    if(used > entry.maxUsed)
+    {
+        entry.maxUsed = used;
+    }
+    if(GetSizeClass(entry.maxUsed) != old_class)
+    {
+        data.version++;
+    }
+}
+
+size_t StackProfiler::GetStackSize(const char* tag)
+{
+    // 每次提交任务都会调用 -> 先查线程本地缓存, 档位没有变化时不碰全局锁
+    struct CachedSize
+    {
+        uint64_t version;
+        size_t size;
+    };
+    static thread_local std::unordered_map<const char*, CachedSize> t_cache;
+
+    StackProfileData& data = GetData();
+    tag = tag ? tag : UNTAGGED;
+    uint64_t version = data.version.load(std::memory_order_acquire);
+    auto it = t_cache.find(tag);
+    if(it != t_cache.end() && it->second.version == version)
+    {
+        return it->second.size;
+    }
+
+    Entry entry;
+    size_t size = Get(tag, entry) ? GetSizeClass(entry.maxUsed) : 0;
+    // 记录读之前的版本 -> 期间有变化时下次重新查询
+    t_cache[tag] = CachedSize{version, size};
+    return size;
+}
+
+const char* StackProfiler::GetTag(const std::function<void()>& cb)
+{
+    return cb.target_type().name();
+}
+
+void StackProfiler::Dump(std::ostream& os)
+{
+    StackProfileData& data = GetData();
+    // 不同指针可能指向相同的名字(如不同编译单元的同名字面量) -> 按名字合并
+    std::map<std::string, Entry> merged;
+    {
+        std::shared_lock<std::shared_mutex> read_lock(data.mutex);
+        for(auto& it : data.entries)
+        {
+            Entry& entry = merged[it.first];
+            entry.count += it.second.count;
+            entry.totalUsed += it.second.totalUsed;
+            if(it.second.maxUsed > entry.maxUsed)
+            {
+                entry.maxUsed = it.second.maxUsed;
+            }
+        }
+    }
+    for(auto& it : merged)
+    {
+        // 类型名 -> 可读形式
+        int status = 0;
+        char* name = abi::__cxa_demangle(it.first.c_str(), nullptr, nullptr, &status);
+        os << (status == 0 ? name : it.first.c_str())
+           << " count=" << it.second.count
+           << " max=" << it.second.maxUsed
+           << " avg=" << (it.second.count ? it.second.totalUsed / it.second.count : 0)
+           << " size_class=" << GetSizeClass(it.second.maxUsed)
+           << std::endl;
+        free(name);
+    }
+}
+
+void StackProfiler::Clear()
+{
+    StackProfileData& data = GetData();
+    std::unique_lock<std::shared_mutex> write_lock(data.mutex);
+    data.entries.clear();
+    data.version++;
+}
+
+}
@@ -0,0 +1,60 @@
+#ifndef _STACK_PROFILER_LY_H_
+#define _STACK_PROFILER_LY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace sylar {
+
+// 协程栈使用量统计
+// 开启后协程栈在分配(及复用)时填充哨兵值, 协程结束时从栈底向上扫描得到最高水位
+// 结果按任务标签(默认为回调函数的类型名)汇总, 标签按指针区分, 需指向静态存储
+// 注意: 填充会访问整个栈, mmap栈的按需分配在统计期间失效, 只建议在压测/预发环境打开
+//
+// 自动栈大小: 打开后Scheduler::scheduleLock按标签的历史最大值加上安全余量选择栈大小档位
+class StackProfiler
+{
+public:
+    struct Entry
+    {
+        // 结束的协程数
+        uint64_t count = 0;
+        // 最高水位
+        size_t maxUsed = 0;
+        // 水位总和, 用于计算平均值
+        uint64_t totalUsed = 0;
+    };
+
+public:
+    static void SetEnabled(bool v);
+    static bool IsEnabled();
+
+    // 开启自动栈大小, 建议值 = 最高水位 * (100 + margin_percent) / 100 + margin_bytes, 再向上取到档位
+    static void SetAutoSize(bool v, size_t margin_percent = 25, size_t margin_bytes = 8192);
+    static bool IsAutoSize();
+
+    // 填充哨兵值
+    static void Paint(void* stack, size_t size);
+    // 扫描最高水位
+    static size_t Measure(void* stack, size_t size);
+
+    // 记录一次协程结束时的水位
+    static void Record(const char* tag, size_t used);
+    // 查询标签的统计结果, 没有数据返回false
+    static bool Get(const char* tag, Entry& entry);
+    // 根据统计选择栈大小档位, 没有数据返回0(使用默认大小); 结果按线程缓存, 档位不变时不加锁
+    static size_t GetStackSize(const char* tag);
+    // 回调任务的默认标签: 回调函数的类型名
+    // 每个lambda各有一个类型, 但普通函数指针(void(*)())和同类型的std::bind都是同一个类型, 共用一条统计
+    static const char* GetTag(const std::function<void()>& cb);
+
+    static void Dump(std::ostream& os);
+    static void Clear();
+};
+
+}
+
+#endif
@@ -0,0 +1,156 @@
+#include "task_scope_ly.h"
+#include "scheduler_ly.h"
+
+#include <cassert>
+
+namespace sylar {
+
+void WaitGroup::add(int64_t n)
+{
+    m_count += n;
+}
+
+void WaitGroup::done()
+{
+    // 不是最后一个 -> 不加锁
+    int64_t count = m_count.load();
+    while(count > 1)
+    {
+        if(m_count.compare_exchange_weak(count, count - 1))
+        {
+            return;
+        }
+    }
+
+    // 归零在锁内进行, wait()也加锁检查 -> 等待者返回(可能随即析构WaitGroup)时这里已经不再访问成员
+    std::vector<FiberWaiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        count = --m_count;
+        assert(count >= 0);
+        if(count == 0)
+        {
+            waiters.swap(m_waiters);
+        }
+    }
+    for(FiberWaiter& waiter : waiters)
+    {
+        waiter.wake();
+    }
+}
+
+void WaitGroup::wait()
+{
+    Semaphore sem;
+    FiberWaiter waiter;
+    waiter.prepare(&sem);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_count == 0)
+        {
+            return;
+        }
+        m_waiters.push_back(waiter);
+    }
+    waiter.wait();
+}
+
+TaskScope::TaskScope(Scheduler* scheduler, size_t limit)
+    : m_scheduler(scheduler ? scheduler : Scheduler::GetThis())
+    , m_limit(limit)
+    , m_slots(limit)
+{
+    assert(m_scheduler);
+}
+
+TaskScope::TaskScope(TaskScope& parent, size_t limit)
+    : m_scheduler(parent.m_scheduler)
+    , m_parent(&parent)
+    , m_limit(limit)
+    , m_slots(limit)
+{
+}
+
+TaskScope::~TaskScope()
+{
+    m_group.wait();
+}
+
+void TaskScope::spawn(std::function<void()> cb, int thread)
+{
+    if(isCancelled())
+    {
+        return;
+    }
+    if(m_limit > 0)
+    {
+        m_slots.wait();
+    }
+
+    m_group.add();
+    m_scheduler->scheduleLock([this, cb]() mutable { run(cb); }, thread);
+}
+
+void TaskScope::run(std::function<void()>& cb)
+{
+    if(!isCancelled())
+    {
+        try
+        {
+            cb();
+        }
+        catch(const TaskCancelled&)
+        {
+            // 取消导致的提前返回
+        }
+        catch(...)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if(!m_exception)
+                {
+                    m_exception = std::current_exception();
+                }
+            }
+            cancel();
+        }
+    }
+    // 先释放回调捕获的对象, done()之后作用域可能已经析构
+    cb = nullptr;
+
+    if(m_limit > 0)
+    {
+        m_slots.signal();
+    }
+    m_group.done();
+}
+
+void TaskScope::join()
+{
+    m_group.wait();
+
+    std::exception_ptr e;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        e.swap(m_exception);
+    }
+    if(e)
+    {
+        std::rethrow_exception(e);
+    }
+}
+
+bool TaskScope::isCancelled() const
+{
+    return m_cancelled || (m_parent && m_parent->isCancelled());
+}
+
+void TaskScope::checkCancelled() const
+{
+    if(isCancelled())
+    {
+        throw TaskCancelled();
+    }
+}
+
+}
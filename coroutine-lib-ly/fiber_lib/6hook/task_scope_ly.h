@@ -0,0 +1,89 @@
+#ifndef _TASK_SCOPE_LY_H_
+#define _TASK_SCOPE_LY_H_
+
+#include "fiber_sync_ly.h"
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace sylar
+{
+
+class Scheduler;
+
+// 等待一组任务结束: add(n)计数, 每个任务结束时done(), wait()挂起当前协程直到计数归零
+class WaitGroup
+{
+public:
+    WaitGroup() = default;
+    WaitGroup(const WaitGroup&) = delete;
+    WaitGroup& operator=(const WaitGroup&) = delete;
+
+    void add(int64_t n = 1);
+    void done();
+    void wait();
+
+    int64_t count() const {return m_count;}
+
+private:
+    std::atomic<int64_t> m_count = {0};
+    std::mutex m_mutex;
+    std::vector<FiberWaiter> m_waiters;
+};
+
+// TaskScope::checkCancelled()抛出, 不作为子任务的异常传播
+class TaskCancelled : public std::runtime_error
+{
+public:
+    TaskCancelled() : std::runtime_error("task scope cancelled") {}
+};
+
+// 结构化并发: 子任务都在作用域内结束, 析构时等待所有子任务, 不会留下孤儿协程
+// 第一个抛出的异常被记录下来并取消作用域, join()重新抛出它
+// 取消是协作式的: 取消后不再启动新的子任务, 正在运行的子任务通过isCancelled()/checkCancelled()检查后提前返回
+class TaskScope
+{
+public:
+    // scheduler为空时使用当前调度器; limit > 0时最多同时运行limit个子任务, spawn超出时挂起等待
+    explicit TaskScope(Scheduler* scheduler = nullptr, size_t limit = 0);
+    // 嵌套作用域: 父作用域取消时这里也视为取消
+    explicit TaskScope(TaskScope& parent, size_t limit = 0);
+    // 只等待, 不抛出异常: 需要异常时先调用join()
+    ~TaskScope();
+
+    TaskScope(const TaskScope&) = delete;
+    TaskScope& operator=(const TaskScope&) = delete;
+
+    // 作用域已取消时不再运行cb
+    void spawn(std::function<void()> cb, int thread = -1);
+
+    // 等待所有子任务结束, 重新抛出第一个异常
+    void join();
+
+    void cancel() {m_cancelled = true;}
+    bool isCancelled() const;
+    // 已取消 -> 抛出TaskCancelled
+    void checkCancelled() const;
+
+private:
+    void run(std::function<void()>& cb);
+
+private:
+    Scheduler* m_scheduler;
+    TaskScope* m_parent = nullptr;
+    std::atomic<bool> m_cancelled = {false};
+    WaitGroup m_group;
+    // 并发上限, 没有上限时不使用
+    size_t m_limit;
+    FiberSemaphore m_slots;
+    std::mutex m_mutex;
+    std::exception_ptr m_exception;
+};
+
+}
+
+#endif
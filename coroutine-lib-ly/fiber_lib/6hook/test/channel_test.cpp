@@ -0,0 +1,81 @@
+#include "ioscheduler_ly.h"
+#include "channel_ly.h"
+
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <string>
+
+using namespace sylar;
+
+// 共享栈协程上的Channel/Select: 挂起期间栈被其他协程覆盖, 等待状态不能留在栈上
+
+static const int N = 20000;
+
+static std::atomic<long> s_sum{0};
+static std::atomic<int> s_count{0};
+
+static void selector(Channel<std::string>* a, Channel<std::string>* b)
+{
+	// 接收的值放在共享栈上: 只有本协程在运行时写入它们
+	std::string va;
+	std::string vb;
+	SelectCase cases[] = {a->recvCase(va), b->recvCase(vb)};
+	while(true)
+	{
+		int idx = Select(cases);
+		if(idx < 0)
+		{
+			break;
+		}
+		s_sum += std::stol(idx == 0 ? va : vb);
+		s_count++;
+	}
+}
+
+static void receiver(Channel<std::string>* c)
+{
+	std::string v;
+	while(c->recv(v))
+	{
+		s_sum += std::stol(v);
+		s_count++;
+	}
+}
+
+static void sender(Channel<std::string>* c, int from)
+{
+	for(int i = from; i < from + N; i++)
+	{
+		// 容量为1, 大部分send都会挂起
+		bool ok = c->send(std::to_string(i));
+		assert(ok);
+		(void)ok;
+	}
+}
+
+int main()
+{
+	Fiber::SetSharedStackConfig(1, 256 * 1024);
+
+	Channel<std::string> a(1);
+	Channel<std::string> b(1);
+	std::atomic<int> senders{2};
+	{
+		IOManager iom(2, true);
+		iom.setSharedStack(true);
+		for(int i = 0; i < 2; i++)
+		{
+			iom.scheduleLock([&a, &b](){selector(&a, &b);});
+			iom.scheduleLock([&a](){receiver(&a);});
+			iom.scheduleLock([&b](){receiver(&b);});
+		}
+		iom.scheduleLock([&](){sender(&a, 0); if(--senders == 0){a.close(); b.close();}});
+		iom.scheduleLock([&](){sender(&b, N); if(--senders == 0){a.close(); b.close();}});
+	}
+
+	long expect = (long)(2 * N - 1) * (2 * N) / 2;
+	std::cout << "count: " << s_count << ", sum: " << s_sum << ", expect: " << 2 * N << ", " << expect << std::endl;
+	assert(s_count == 2 * N && s_sum == expect);
+	return 0;
+}
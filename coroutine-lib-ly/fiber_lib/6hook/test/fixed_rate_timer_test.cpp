@@ -0,0 +1,123 @@
+#include "timer_ly.h"
+
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+using namespace sylar;
+using Clock = std::chrono::steady_clock;
+
+// 固定频率timer: CATCH_UP补齐错过的周期且不累积漂移, SKIP丢弃错过的周期并保持相位
+// 单线程忙等驱动TimerManager, 不依赖调度器
+
+static void spin(std::chrono::microseconds d)
+{
+	auto end = Clock::now() + d;
+	while(Clock::now() < end);
+}
+
+// 取出超时的timer并执行回调
+static void poll(TimerManager& manager)
+{
+	std::vector<std::function<void()>> cbs;
+	manager.listExpiredCb(cbs);
+	for(auto& cb : cbs)
+	{
+		cb();
+	}
+}
+
+// 10000个周期, 每次回调处理30%的周期, 每1000次额外卡住15个周期
+// 固定延迟的timer会累积约600ms的漂移, CATCH_UP结束时仍在第10000个周期附近
+static void testCatchUpDrift()
+{
+	const long N = 10000;
+	const auto period = std::chrono::microseconds(200);
+
+	TimerManager manager;
+	long fired = 0;
+	Clock::time_point end;
+	Clock::time_point start = Clock::now();
+	std::shared_ptr<Timer> timer = manager.addFixedRateTimer(period, [&](){
+		long k = ++fired;
+		Clock::time_point now = Clock::now();
+		// 第k次不会早于第k个周期
+		assert(now >= start + k * period);
+		if(k == N)
+		{
+			end = now;
+		}
+		spin(period * 3 / 10);
+		if(k % 1000 == 0)
+		{
+			spin(period * 15);
+		}
+	}, TimerManager::CATCH_UP);
+
+	while(fired < N)
+	{
+		poll(manager);
+	}
+	timer->cancel();
+
+	double drift = std::chrono::duration<double, std::milli>(end - (start + N * period)).count();
+	std::cout << "catch up: fired " << fired << ", end vs start + N * period: " << drift << " ms" << std::endl;
+	assert(fired == N);
+	assert(drift >= 0 && drift < 5);
+}
+
+// 20ms周期, 第3次回调卡住110ms(5.5个周期), 运行到第15个周期之后
+// CATCH_UP: 15次都触发 SKIP: 错过的4个周期合并为1次, 之后回到原来的相位
+static void testMissedTicks(TimerManager::MissedTicks missed)
+{
+	const auto period = std::chrono::milliseconds(20);
+
+	TimerManager manager;
+	std::vector<Clock::time_point> fires;
+	Clock::time_point start = Clock::now();
+	std::shared_ptr<Timer> timer = manager.addFixedRateTimer(period, [&](){
+		fires.push_back(Clock::now());
+		if(fires.size() == 3)
+		{
+			spin(std::chrono::milliseconds(110));
+		}
+	}, missed);
+
+	while(Clock::now() < start + 15 * period + period / 2)
+	{
+		poll(manager);
+	}
+	timer->cancel();
+
+	std::cout << (missed == TimerManager::CATCH_UP ? "catch up" : "skip") << ": fired " << fires.size() << " in 15 periods" << std::endl;
+	if(missed == TimerManager::CATCH_UP)
+	{
+		assert(fires.size() == 15);
+		return;
+	}
+
+	assert(fires.size() == 11);
+	// 第4次是卡住后补的那一次, 之后都落在原来的周期点上
+	for(size_t i = 4; i < fires.size(); i++)
+	{
+		auto offset = (fires[i] - start) % period;
+		assert(offset < std::chrono::milliseconds(5));
+		(void)offset;
+	}
+}
+
+int main()
+{
+	for(TimerManager::QueueType type : {TimerManager::HEAP, TimerManager::WHEEL})
+	{
+		TimerManager::SetDefaultQueue(type);
+		std::cout << (type == TimerManager::HEAP ? "heap" : "wheel") << std::endl;
+		testCatchUpDrift();
+		testMissedTicks(TimerManager::CATCH_UP);
+		testMissedTicks(TimerManager::SKIP);
+	}
+	std::cout << "ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,100 @@
+#include "ioscheduler_ly.h"
+#include "fd_manager_ly.h"
+#include "hook_ly.h"
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace sylar;
+
+// io_uring后端: 同时在途的操作远多于CQ大小时, 完成事件不能丢
+// N个socketpair, 每个上一个协程挂在recv上
+// 默认写入数据唤醒; 参数 timeout -> 300ms的SO_RCVTIMEO, 每个操作都被取消
+
+static const int N = 4000;
+
+static std::atomic<int> s_parked{0};
+static std::atomic<int> s_done{0};
+
+int main(int argc, char** argv)
+{
+	bool timeout = argc > 1 && strcmp(argv[1], "timeout") == 0;
+	rlimit rl{16384, 16384};
+	setrlimit(RLIMIT_NOFILE, &rl);
+
+	std::vector<int> a(N);
+	std::vector<int> b(N);
+	for(int i = 0; i < N; i++)
+	{
+		int sv[2];
+		int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+		assert(rt == 0);
+		(void)rt;
+		a[i] = sv[0];
+		b[i] = sv[1];
+	}
+
+	// 丢了完成事件的协程永远不会醒, 10秒内没全部完成就算失败
+	std::thread([](){
+		// 看门狗线程不走hook
+		set_hook_enable(false);
+		poll(nullptr, 0, 10000);
+		std::cout << "hang: " << s_done << "/" << N << " done" << std::endl;
+		_exit(1);
+	}).detach();
+
+	{
+		IOManager iom(2, true, "IOManager", false, IOManager::IO_URING);
+		std::cout << (iom.getBackend() == IOManager::IO_URING ? "io_uring" : "epoll (io_uring unsupported)")
+			<< (timeout ? ", timeout" : ", write") << std::endl;
+		for(int i = 0; i < N; i++)
+		{
+			iom.scheduleLock([&a, i, timeout](){
+				FdMgr::GetInstance()->get(a[i], true);
+				if(timeout)
+				{
+					timeval tv{0, 300000};
+					setsockopt(a[i], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+				}
+				s_parked++;
+				char c;
+				ssize_t n = recv(a[i], &c, 1, 0);
+				assert(timeout ? n == -1 && errno == ETIMEDOUT : n == 1);
+				(void)n;
+				s_done++;
+			});
+		}
+		if(!timeout)
+		{
+			iom.scheduleLock([&b](){
+				while(s_parked < N)
+				{
+					usleep(1000);
+				}
+				usleep(300000);
+				for(int i = 0; i < N; i++)
+				{
+					write(b[i], "x", 1);
+				}
+			});
+		}
+	}
+	assert(s_done == N);
+
+	for(int i = 0; i < N; i++)
+	{
+		close(a[i]);
+		close(b[i]);
+	}
+	std::cout << "ok" << std::endl;
+	return 0;
+}
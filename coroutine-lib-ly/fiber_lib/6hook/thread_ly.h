@@ -2,6 +2,7 @@
 #define _THREAD_LY_H_
 
 #include <mutex>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 
@@ -30,6 +31,23 @@ public:
         count--;
     }
 
+    // p, 最多等待ms毫秒, 超时返回false
+    bool waitFor(uint64_t ms)
+    {
+        return waitFor(std::chrono::milliseconds(ms));
+    }
+
+    bool waitFor(std::chrono::nanoseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        if(!cv.wait_for(lock, timeout, [this](){return count > 0;}))
+        {
+            return false;
+        }
+        count--;
+        return true;
+    }
+
     // v
     void signal()
     {
@@ -1,24 +1,172 @@
 #include "timer_ly.h"
+#include "timer_wheel_ly.h"
+
+#include <atomic>
+#include <algorithm>
 
 namespace sylar{
 
-bool Timer::cancel()
+static std::atomic<TimerManager::QueueType> s_default_queue{TimerManager::HEAP};
+
+// 毫秒转纳秒, 截断到约146年 -> 超时时间不会溢出
+static std::chrono::nanoseconds MsToNs(uint64_t ms)
 {
-    std::unique_lock<std::shared_mutex> write_lock(m_manager->m_mutex);
+    static const uint64_t MAX_MS = std::chrono::nanoseconds::max().count() / 1000000 / 2;
+    return std::chrono::milliseconds(std::min(ms, MAX_MS));
+}
+
+// 按超时时间的二叉最小堆, 节点记录自己的下标 -> 删除不需要查找, 不为每个timer分配节点
+class TimerHeap : public TimerQueue
+{
+public:
+    bool insert(TimerNode* timer) override
+    {
+        timer->m_queueIndex = (int)m_heap.size();
+        m_heap.push_back(timer);
+        siftUp(timer->m_queueIndex);
+        return timer->m_queueIndex == 0;
+    }
+
+    bool erase(TimerNode* timer) override
+    {
+        if(timer->m_queueIndex < 0)
+        {
+            return false;
+        }
+        removeAt(timer->m_queueIndex);
+        return true;
+    }
+
+    bool front(TimerNode::TimePoint& next) override
+    {
+        if(m_heap.empty())
+        {
+            return false;
+        }
+        next = m_heap[0]->m_next;
+        return true;
+    }
+
+    void popExpired(TimerNode::TimePoint now, std::vector<TimerNode*>& expired) override
+    {
+        while(!m_heap.empty() && m_heap[0]->m_next < now)
+        {
+            expired.push_back(m_heap[0]);
+            removeAt(0);
+        }
+    }
+
+    void popAll(std::vector<TimerNode*>& expired) override
+    {
+        for(TimerNode* timer : m_heap)
+        {
+            timer->m_queueIndex = -1;
+            expired.push_back(timer);
+        }
+        m_heap.clear();
+    }
+
+    bool empty() const override
+    {
+        return m_heap.empty();
+    }
+
+private:
+    void removeAt(size_t index)
+    {
+        m_heap[index]->m_queueIndex = -1;
+        TimerNode* last = m_heap.back();
+        m_heap.pop_back();
+        if(index < m_heap.size())
+        {
+            // 最后一个节点补到空位, 再向上或向下调整
+            place(index, last);
+            siftDown(index);
+            siftUp(last->m_queueIndex);
+        }
+    }
+
+    void siftUp(size_t index)
+    {
+        TimerNode* timer = m_heap[index];
+        while(index > 0)
+        {
+            size_t parent = (index - 1) / 2;
+            if(!(timer->m_next < m_heap[parent]->m_next))
+            {
+                break;
+            }
+            place(index, m_heap[parent]);
+            index = parent;
+        }
+        place(index, timer);
+    }
+
+    void siftDown(size_t index)
+    {
+        TimerNode* timer = m_heap[index];
+        size_t size = m_heap.size();
+        while(true)
+        {
+            size_t child = index * 2 + 1;
+            if(child >= size)
+            {
+                break;
+            }
+            if(child + 1 < size && m_heap[child + 1]->m_next < m_heap[child]->m_next)
+            {
+                child++;
+            }
+            if(!(m_heap[child]->m_next < timer->m_next))
+            {
+                break;
+            }
+            place(index, m_heap[child]);
+            index = child;
+        }
+        place(index, timer);
+    }
 
-    if(m_cb == nullptr)
+    void place(size_t index, TimerNode* timer)
+    {
+        m_heap[index] = timer;
+        timer->m_queueIndex = (int)index;
+    }
+
+private:
+    std::vector<TimerNode*> m_heap;
+};
+
+bool Timer::cancel()
+{
+    int state = PENDING;
+    if(!m_state.compare_exchange_strong(state, CANCELLED))
     {
         return false;
     }
-    else{
+
+    TimerManager::Shard& shard = *m_manager->m_shards[m_shard];
+    shard.count--;
+
+    if(m_manager->getTimerShard() == m_shard)
+    {
+        // 分片的所有者 -> 直接删除, 调用方持有timer, 释放自引用是安全的
+        std::lock_guard<std::mutex> lock(shard.mutex);
         m_cb = nullptr;
+        if(shard.timers->erase(this))
+        {
+            m_self.reset();
+        }
+        return true;
     }
 
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if(it != m_manager->m_timers.end())
+    // 其他线程 -> 挂到取消链表上, 不和所有者争锁
+    // 所有者取timer前删除它; 在那之前超时也不会执行
+    Timer* head = shard.cancelled.load(std::memory_order_relaxed);
+    do
     {
-        m_manager->m_timers.erase(it);
-    }
+        m_cancelNext = head;
+    } while(!shard.cancelled.compare_exchange_weak(head, this, std::memory_order_release, std::memory_order_relaxed));
 
     return true;
 }
@@ -26,83 +174,154 @@ bool Timer::cancel()
 // refresh 只会向后调整时间
 bool Timer::refresh()
 {
-    std::unique_lock<std::shared_mutex> write_lock(m_manager->m_mutex);
+    TimerManager::Shard& shard = *m_manager->m_shards[m_shard];
+    std::lock_guard<std::mutex> lock(shard.mutex);
 
-    if(!m_cb){
+    if(m_state != PENDING){
         return false;
     }
 
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if(m_manager->m_timers.end() == it)
+    if(!shard.timers->erase(this))
     {
         return false;
     }
 
-    m_manager->m_timers.erase(it);
-    m_next = std::chrono::system_clock::now() + 
-                std::chrono::milliseconds(m_ms);
-    m_manager->m_timers.insert(shared_from_this());
+    m_next = Clock::now() + m_interval;
+    shard.timers->insert(this);
 
     return true;
 }
 
 bool Timer::reset(uint64_t ms, bool from_now)
 {
-    if(ms == m_ms && from_now == false)
+    std::chrono::nanoseconds interval = MsToNs(ms);
+    if(interval == m_interval && from_now == false)
     {
         return true;
     }
 
+    // 留在原来的分片
+    TimerManager::Shard& shard = *m_manager->m_shards[m_shard];
+    bool remote = m_manager->getTimerShard() != m_shard;
+    bool at_front = false;
     {
-        std::unique_lock<std::shared_mutex> write_lock(m_manager->m_mutex);
+        std::lock_guard<std::mutex> lock(shard.mutex);
         
-        if(!m_cb)
+        if(m_state != PENDING)
         {
             return false;
         }
         
-        auto it = m_manager->m_timers.find(shared_from_this());
-        if(it == m_manager->m_timers.end())
+        if(!shard.timers->erase(this))
         {
             return false;
         }
-        m_manager->m_timers.erase(it);
+
+        // reinsert
+        auto start = from_now ? Clock::now() : m_next - m_interval;
+        m_next = start + interval;
+        m_interval = interval;
+        at_front = m_manager->insertLocked(shard, this, remote);
     }
-    // reinsert
-    auto start = from_now ? std::chrono::system_clock::now() : m_next - std::chrono::milliseconds(m_ms);
-    m_next = start + std::chrono::milliseconds(ms);
-    m_ms = ms;
-    m_manager->addTimer(shared_from_this()); // insert with lock
 
+    if(at_front)
+    {
+        m_manager->onTimerInsertedAtFront(m_shard);
+    }
     return true;
 }
 
-Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager):
-m_recurring(recurring), m_ms(ms), m_cb(cb), m_manager(manager)
+Timer::Timer(std::chrono::nanoseconds interval, std::function<void()> cb, bool recurring, TimerManager* manager):
+TimerNode(false), m_recurring(recurring), m_interval(interval), m_cb(cb), m_manager(manager)
+{
+    m_next = Clock::now() + m_interval;
+}
+
+TimerEntry::TimerEntry(Callback cb, void* arg):
+TimerNode(true), m_cb(cb), m_arg(arg)
 {
-    auto now = std::chrono::system_clock::now();
-    m_next = now + std::chrono::milliseconds(m_ms);
 }
 
-bool Timer::Comparator::operator()(const std::shared_ptr<Timer>& lhs, const std::shared_ptr<Timer>& rhs) const
+TimerEntry::~TimerEntry()
 {
-    assert(lhs!=nullptr && rhs!=nullptr);
-    return lhs->m_next < rhs->m_next;
+    cancel();
 }
 
-TimerManager::TimerManager()
+bool TimerEntry::cancel()
 {
-    m_previouseTime = std::chrono::system_clock::now();
+    // 从未添加过
+    if(!m_manager)
+    {
+        return false;
+    }
+    return m_manager->cancelEntry(this, 0, false);
+}
+
+void TimerManager::SetDefaultQueue(QueueType type)
+{
+    s_default_queue = type;
+}
+
+TimerManager::QueueType TimerManager::GetDefaultQueue()
+{
+    return s_default_queue;
+}
+
+TimerManager::TimerManager(size_t shards)
+{
+    assert(shards > 0);
+    m_shards.resize(shards);
+    for(auto& shard : m_shards)
+    {
+        shard.reset(new Shard());
+        if(s_default_queue == WHEEL)
+        {
+            shard->timers.reset(new TimerWheel(Timer::Clock::now()));
+        }
+        else
+        {
+            shard->timers.reset(new TimerHeap());
+        }
+    }
 }
 
 TimerManager::~TimerManager()
 {
+    // 释放timer的自引用, 还在等待的TimerEntry与管理器解除关联
+    std::vector<TimerNode*> remaining;
+    for(auto& shard : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        // 先处理取消链表, 其中的Timer可能还在队列中
+        drainCancelled(*shard);
+        shard->timers->popAll(remaining);
+    }
+    for(TimerNode* node : remaining)
+    {
+        if(node->m_intrusive)
+        {
+            static_cast<TimerEntry*>(node)->m_manager = nullptr;
+        }
+        else
+        {
+            static_cast<Timer*>(node)->m_self.reset();
+        }
+    }
+}
 
+int TimerManager::pickTimerShard()
+{
+    return m_nextShard++ % m_shards.size();
 }
 
 std::shared_ptr<Timer> TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool recurring)
 {
-    std::shared_ptr<Timer> timer(new Timer(ms, cb, recurring, this)); 
+    return addTimer(MsToNs(ms), std::move(cb), recurring);
+}
+
+std::shared_ptr<Timer> TimerManager::addTimer(std::chrono::nanoseconds timeout, std::function<void()> cb, bool recurring)
+{
+    std::shared_ptr<Timer> timer(new Timer(timeout, std::move(cb), recurring, this)); 
     addTimer(timer);
 
     return timer;
@@ -123,23 +342,152 @@ std::shared_ptr<Timer> TimerManager::addConditionTimer(uint64_t ms, std::functio
     return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
 }
 
+std::shared_ptr<Timer> TimerManager::addConditionTimer(std::chrono::nanoseconds timeout, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool recurring) 
+{
+    return addTimer(timeout, std::bind(&OnTimer, weak_cond, cb), recurring);
+}
+
+std::shared_ptr<Timer> TimerManager::addFixedRateTimer(uint64_t ms, std::function<void()> cb, MissedTicks missed)
+{
+    return addFixedRateTimer(MsToNs(ms), std::move(cb), missed);
+}
+
+std::shared_ptr<Timer> TimerManager::addFixedRateTimer(std::chrono::nanoseconds period, std::function<void()> cb, MissedTicks missed)
+{
+    // 周期为0时固定频率会一直追赶
+    period = std::max(period, std::chrono::nanoseconds(1));
+    std::shared_ptr<Timer> timer(new Timer(period, std::move(cb), true, this));
+    timer->m_fixedRate = true;
+    timer->m_skipMissed = missed == SKIP;
+    addTimer(timer);
+
+    return timer;
+}
+
+TimerHandle TimerManager::addTimer(TimerEntry& entry, std::chrono::nanoseconds timeout)
+{
+    int current = getTimerShard();
+    int index = current >= 0 ? current : pickTimerShard();
+
+    // 还在另一个管理器或另一个分片中等待
+    if(entry.m_manager && (entry.m_manager != this || entry.m_shard != index))
+    {
+        entry.cancel();
+    }
+
+    Shard& shard = *m_shards[index];
+    TimerHandle handle;
+    bool at_front = false;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if(!shard.timers->erase(&entry))
+        {
+            shard.count++;
+        }
+        entry.m_manager = this;
+        entry.m_shard = index;
+        entry.m_generation++;
+        entry.m_next = TimerNode::Clock::now() + timeout;
+        at_front = insertLocked(shard, &entry, index != current);
+
+        handle.entry = &entry;
+        handle.generation = entry.m_generation;
+    }
+
+    if(at_front)
+    {
+        onTimerInsertedAtFront(index);
+    }
+    return handle;
+}
+
+bool TimerManager::cancelTimer(const TimerHandle& handle)
+{
+    if(!handle.entry)
+    {
+        return false;
+    }
+    return cancelEntry(handle.entry, handle.generation, true);
+}
+
+bool TimerManager::cancelEntry(TimerEntry* entry, uint64_t generation, bool check_generation)
+{
+    Shard& shard = *m_shards[entry->m_shard];
+    std::unique_lock<std::mutex> lock(shard.mutex);
+
+    bool cancelled = false;
+    if(entry->m_manager == this && (!check_generation || entry->m_generation == generation))
+    {
+        cancelled = shard.timers->erase(entry);
+        if(cancelled)
+        {
+            shard.count--;
+        }
+    }
+
+    // 回调正在其他线程执行 -> 等它结束, 之后不会再访问entry
+    // 在自己的回调中取消 -> 不等待
+    std::thread::id self = std::this_thread::get_id();
+    while(true)
+    {
+        auto it = std::find_if(shard.running.begin(), shard.running.end(), 
+            [entry](const std::pair<TimerEntry*, std::thread::id>& running) { return running.first == entry; });
+        if(it == shard.running.end() || it->second == self)
+        {
+            break;
+        }
+        lock.unlock();
+        std::this_thread::yield();
+        lock.lock();
+    }
+    return cancelled;
+}
+
 uint64_t TimerManager::getNextTimer()
 {
-    std::shared_lock<std::shared_mutex> read_lock(m_mutex);
+    uint64_t ns = getNextTimerNs();
+    if(ns == ~0ull)
+    {
+        return ~0ull;
+    }
+    // 向下取整会在超时前醒来, 然后以0超时空转到超时
+    return (ns + 999999) / 1000000;
+}
+
+uint64_t TimerManager::getNextTimerNs()
+{
+    auto now = Timer::Clock::now();
+    int current = getTimerShard();
+    if(current >= 0)
+    {
+        return getNextTimerNs(*m_shards[current], now);
+    }
+
+    uint64_t next = ~0ull;
+    for(auto& shard : m_shards)
+    {
+        next = std::min(next, getNextTimerNs(*shard, now));
+    }
+    return next;
+}
+
+uint64_t TimerManager::getNextTimerNs(Shard& shard, Timer::TimePoint now)
+{
+    std::lock_guard<std::mutex> lock(shard.mutex);
 
     // reset m_tickled
-    m_tickled = false;
+    shard.tickled = false;
+
+    // 已取消的timer不再决定等待时间
+    drainCancelled(shard);
 
-    if(m_timers.empty())
+    Timer::TimePoint time;
+    if(!shard.timers->front(time))
     {
         // 返回最大值
         return ~0ull;
     }
 
-    auto it = m_timers.begin();
-    auto now = std::chrono::system_clock::now();
-    auto time = (*it)->m_next;
-
     if(now >= time)
     {
         // 已经有timer超时
@@ -147,7 +495,8 @@ uint64_t TimerManager::getNextTimer()
     }
     else
     {
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(time - now);
+        // 多等slack -> 这段时间内超时的timer在同一次唤醒中触发
+        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(time - now) + std::chrono::nanoseconds(m_slack.load(std::memory_order_relaxed));
         return static_cast<uint64_t>(duration.count());
     }
 
@@ -155,35 +504,128 @@ uint64_t TimerManager::getNextTimer()
 
 void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs)
 {
-    auto now = std::chrono::system_clock::now();
+    auto now = Timer::Clock::now();
+    int current = getTimerShard();
+    if(current >= 0)
+    {
+        listExpiredCb(*m_shards[current], now, cbs);
+        return;
+    }
+
+    for(auto& shard : m_shards)
+    {
+        listExpiredCb(*shard, now, cbs);
+    }
+}
+
+void TimerManager::listExpiredCb(Shard& shard, Timer::TimePoint now, std::vector<std::function<void()>>& cbs)
+{
+    // 每个线程复用, 取超时timer时不分配内存
+    struct Fired
+    {
+        TimerEntry* entry;
+        TimerEntry::Callback cb;
+        void* arg;
+    };
+    static thread_local std::vector<TimerNode*> t_expired;
+    static thread_local std::vector<Fired> t_fired;
 
-    std::unique_lock<std::shared_mutex> write_lock(m_mutex);
+    std::thread::id self = std::this_thread::get_id();
 
-    bool rollover = detectClockRollover();
-    // 回退 -> 清理所有timer || 超时 -> 清理超时timer
-    while(!m_timers.empty() && rollover || !m_timers.empty() && (*m_timers.begin())->m_next < now)
     {
-        std::shared_ptr<Timer> temp = *m_timers.begin();
-        m_timers.erase(m_timers.begin());
+        std::lock_guard<std::mutex> lock(shard.mutex);
 
-        cbs.push_back(temp->m_cb);
+        drainCancelled(shard);
 
-        if(temp->m_recurring)
+        // 清理超时timer
+        t_expired.clear();
+        shard.timers->popExpired(now, t_expired);
+
+        for(TimerNode* node : t_expired)
         {
-            temp->m_next = now + std::chrono::milliseconds(temp->m_ms);
-            m_timers.insert(temp);
-        }
-        else{
+            if(node->m_intrusive)
+            {
+                TimerEntry* entry = static_cast<TimerEntry*>(node);
+                shard.count--;
+                if(entry->m_cb)
+                {
+                    // 回调结束前cancel()会等待
+                    shard.running.emplace_back(entry, self);
+                    t_fired.push_back({entry, entry->m_cb, entry->m_arg});
+                }
+                continue;
+            }
+
+            Timer* temp = static_cast<Timer*>(node);
+
+            if(temp->m_recurring)
+            {
+                // 已被其他线程取消 -> 不再加入, 由drainCancelled()释放
+                if(temp->m_state != Timer::PENDING)
+                {
+                    continue;
+                }
+                cbs.push_back(temp->m_cb);
+                if(!temp->m_fixedRate)
+                {
+                    temp->m_next = now + temp->m_interval;
+                }
+                else
+                {
+                    temp->m_next += temp->m_interval;
+                    if(temp->m_next <= now && temp->m_skipMissed)
+                    {
+                        // 跳过错过的周期, 仍对齐到原来的周期
+                        auto missed = (now - temp->m_next) / temp->m_interval + 1;
+                        temp->m_next += missed * temp->m_interval;
+                    }
+                    // CATCH_UP -> 已经超时, 下次取超时timer时再触发
+                }
+                shard.timers->insert(temp);
+                continue;
+            }
+
+            int state = Timer::PENDING;
+            if(!temp->m_state.compare_exchange_strong(state, Timer::FIRED))
+            {
+                continue;
+            }
+            shard.count--;
+            cbs.push_back(std::move(temp->m_cb));
             // 清理cb 
             temp->m_cb = nullptr;
+            temp->m_self.reset();
+        }
+    }
+
+    for(const Fired& fired : t_fired)
+    {
+        fired.cb(fired.arg);
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for(size_t i = 0; i < shard.running.size(); i++)
+        {
+            if(shard.running[i].first == fired.entry && shard.running[i].second == self)
+            {
+                shard.running[i] = shard.running.back();
+                shard.running.pop_back();
+                break;
+            }
         }
     }
+    t_fired.clear();
 }
 
 bool TimerManager::hasTimer()
 {
-    std::shared_lock<std::shared_mutex> read_lock(m_mutex);
-    return !m_timers.empty();
+    for(auto& shard : m_shards)
+    {
+        if(shard->count > 0)
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
 
@@ -192,41 +634,53 @@ bool TimerManager::hasTimer()
 // lock + tickle()
 void TimerManager::addTimer(std::shared_ptr<Timer> timer)
 {
+    int current = getTimerShard();
+    int index = current >= 0 ? current : pickTimerShard();
+    Shard& shard = *m_shards[index];
+    timer->m_shard = index;
+
     bool at_front = false;
     {
-        std::unique_lock<std::shared_mutex> write_lock(m_mutex);
-        auto it = m_timers.insert(timer).first; // 返回值为std::pair<iterator, bool>
-        at_front = (it == m_timers.begin()) && !m_tickled;
-        
-        // only tickle once  
-        // till one thread wakes up and runs getNextTime()
-        if(at_front)
-        {
-            m_tickled = true;
-        }
-
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        timer->m_self = timer;
+        shard.count++;
+        at_front = insertLocked(shard, timer.get(), index != current);
     }
 
     if(at_front)
     {
         // // wake up 
-        onTimerInsertedAtFront();
+        onTimerInsertedAtFront(index);
     }
 }
 
+bool TimerManager::insertLocked(Shard& shard, TimerNode* timer, bool remote)
+{
+    // 所有者自己插入 -> 它在下次等待前会重新计算超时时间, 不需要唤醒
+    bool at_front = shard.timers->insert(timer) && remote && !shard.tickled;
+
+    // only tickle once  
+    // till one thread wakes up and runs getNextTime()
+    if(at_front)
+    {
+        shard.tickled = true;
+    }
+    return at_front;
+}
 
-bool TimerManager::detectClockRollover() 
+void TimerManager::drainCancelled(Shard& shard)
 {
-    bool rollover = false;
-    auto now = std::chrono::system_clock::now();
-    // 判断当前时间是否比（上一次时间 - 1小时）更早
-    if(now < (m_previouseTime - std::chrono::milliseconds(60 * 60 * 1000))) 
+    Timer* timer = shard.cancelled.exchange(nullptr, std::memory_order_acquire);
+    while(timer)
     {
-        rollover = true;
+        // 释放自引用后timer可能被销毁
+        Timer* next = timer->m_cancelNext;
+        shard.timers->erase(timer);
+        timer->m_cb = nullptr;
+        timer->m_self.reset();
+        timer = next;
     }
-    m_previouseTime = now;
-    return rollover;
 }
 
 
-}
\ No newline at end of file
+}
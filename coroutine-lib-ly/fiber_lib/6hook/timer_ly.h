@@ -4,18 +4,45 @@
 #include <memory>
 #include <functional>
 #include <chrono>
-#include <shared_mutex>
-#include <set>
 #include <vector>
+#include <atomic>
 #include <assert.h>
 #include <mutex>
+#include <thread>
 
 namespace sylar
 {
 
 class TimerManager;
+class TimerHeap;
+class TimerWheel;
 
-class Timer : public std::enable_shared_from_this<Timer>
+// 定时器队列中的节点, 队列只通过它排序和定位, 不持有所有权
+class TimerNode
+{
+    friend class TimerManager;
+    friend class TimerHeap;
+    friend class TimerWheel;
+public:
+    // 单调时钟, 不受系统时间调整影响
+    typedef std::chrono::steady_clock Clock;
+    typedef Clock::time_point TimePoint;
+
+protected:
+    explicit TimerNode(bool intrusive) : m_intrusive(intrusive) {}
+
+    // 绝对超时时间
+    TimePoint m_next;
+    // 堆中的下标或时间轮的槽位, 不在队列中为-1
+    int m_queueIndex = -1;
+    // 时间轮槽位链表
+    TimerNode* m_wheelPrev = nullptr;
+    TimerNode* m_wheelNext = nullptr;
+    // true -> TimerEntry, false -> Timer
+    bool m_intrusive;
+};
+
+class Timer : public TimerNode, public std::enable_shared_from_this<Timer>
 {
     friend class TimerManager;
 public:
@@ -27,74 +54,221 @@ public:
     bool reset(uint64_t ms, bool from_now);
 
 private:
-    Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager);
+    Timer(std::chrono::nanoseconds interval, std::function<void()> cb, bool recurring, TimerManager* manager);
+
+    enum State
+    {
+        PENDING,
+        FIRED,
+        CANCELLED
+    };
 
 private:
+    // PENDING -> FIRED/CANCELLED只发生一次, 由CAS决定, 不需要分片的锁
+    std::atomic<int> m_state = {PENDING};
+    // 所在的分片
+    int m_shard = 0;
+    // 分片的取消消息链表
+    Timer* m_cancelNext = nullptr;
     // 是否循环
     bool m_recurring = false;
+    // 循环timer按上次的超时时间加周期重新加入, 否则按取出时的时间加周期
+    bool m_fixedRate = false;
+    // 固定频率时跳过错过的周期
+    bool m_skipMissed = false;
     // 超时时间
-    uint64_t m_ms = 0;
-    // 绝对超时时间
-    std::chrono::time_point<std::chrono::system_clock> m_next;
-    // 超时时触发的回调函数
+    std::chrono::nanoseconds m_interval{0};
+    // 超时时触发的回调函数, 只在分片的锁下访问
     std::function<void()> m_cb;
     // 管理此timer的管理器
     TimerManager* m_manager = nullptr;
+    // 在队列中时持有自身, 取出时释放
+    std::shared_ptr<Timer> m_self;
+};
+
+class TimerEntry;
+
+// 一次添加的句柄, TimerEntry重新添加后旧句柄失效
+struct TimerHandle
+{
+    TimerEntry* entry = nullptr;
+    uint64_t generation = 0;
+};
+
+// 嵌入在调用方对象(连接, 等待槽)中的定时器, 添加/取消都不分配内存
+// 回调在TimerManager::listExpiredCb中直接执行, 必须短小且不阻塞
+// cancel()返回后管理器不会再访问它(回调正在其他线程执行时等它结束) -> 随即可以销毁; 析构时自动cancel
+// 管理器必须比处于等待中的TimerEntry活得久
+class TimerEntry : public TimerNode
+{
+    friend class TimerManager;
+public:
+    typedef void (*Callback)(void* arg);
+
+    explicit TimerEntry(Callback cb = nullptr, void* arg = nullptr);
+    ~TimerEntry();
+
+    TimerEntry(const TimerEntry&) = delete;
+    TimerEntry& operator=(const TimerEntry&) = delete;
+
+    // 只能在不处于等待中时调用
+    void setCallback(Callback cb, void* arg) { m_cb = cb; m_arg = arg; }
+
+    // 取消当前这次添加, 不在等待中返回false
+    bool cancel();
 
 private:
-    // 实现最小堆的比较函数
-    struct Comparator
-    {
-        bool operator()(const std::shared_ptr<Timer>& lhs, const std::shared_ptr<Timer>& rhs) const;
-    };
+    Callback m_cb;
+    void* m_arg;
+    TimerManager* m_manager = nullptr;
+    // 所在的分片
+    int m_shard = 0;
+    // 每次添加加一, 由分片的锁保护
+    uint64_t m_generation = 0;
+};
+
+// 定时器的存储结构, 调用方持有分片的锁
+class TimerQueue
+{
+public:
+    virtual ~TimerQueue() {}
+
+    // 插入timer, 返回它是否可能成为最早的timer
+    virtual bool insert(TimerNode* timer) = 0;
+    // 删除timer, 不在队列中返回false
+    virtual bool erase(TimerNode* timer) = 0;
+    // 最早的超时时间(可以偏早), 队列为空返回false
+    virtual bool front(TimerNode::TimePoint& next) = 0;
+    // 取出所有在now之前超时的timer
+    virtual void popExpired(TimerNode::TimePoint now, std::vector<TimerNode*>& expired) = 0;
+    // 取出所有timer
+    virtual void popAll(std::vector<TimerNode*>& expired) = 0;
+    virtual bool empty() const = 0;
 };
 
 class TimerManager
 {
     friend class Timer;
+    friend class TimerEntry;
+
+public:
+    // HEAP:  按超时时间的最小堆, 插入/删除O(log n)
+    // WHEEL: 分层时间轮, 插入/删除O(1), 超时按1ms的刻度归档后逐层下放
+    enum QueueType
+    {
+        HEAP,
+        WHEEL
+    };
+
+    // 固定频率的循环timer处理不及时错过了周期
+    // CATCH_UP: 每次取超时timer补触发一次, 直到追上
+    // SKIP:     只触发一次, 跳到现在之后的下一个周期
+    enum MissedTicks
+    {
+        CATCH_UP,
+        SKIP
+    };
+
+    // 之后创建的TimerManager使用的存储结构
+    static void SetDefaultQueue(QueueType type);
+    static QueueType GetDefaultQueue();
 
 public:
-    TimerManager();
+    // 定时器按分片存放, 每个分片有自己的锁和队列
+    // 拥有分片的线程(IOManager的工作线程)添加的timer放在自己的分片上, 只有它取超时timer
+    // 其他线程取消Timer时只把它挂到分片的取消链表上, 由所有者下次取timer时删除
+    explicit TimerManager(size_t shards = 1);
     virtual ~TimerManager();
 
     // 添加timer
     std::shared_ptr<Timer> addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
-    
+    // 纳秒精度
+    std::shared_ptr<Timer> addTimer(std::chrono::nanoseconds timeout, std::function<void()> cb, bool recurring = false);
+
     // 添加条件timer
     std::shared_ptr<Timer> addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool recurring = false);
+    std::shared_ptr<Timer> addConditionTimer(std::chrono::nanoseconds timeout, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool recurring = false);
+
+    // 添加固定频率的循环timer, 第k次超时时间为添加时间加k个周期, 不随处理延迟漂移
+    std::shared_ptr<Timer> addFixedRateTimer(uint64_t ms, std::function<void()> cb, MissedTicks missed = SKIP);
+    std::shared_ptr<Timer> addFixedRateTimer(std::chrono::nanoseconds period, std::function<void()> cb, MissedTicks missed = SKIP);
+
+    // 添加嵌入式timer, 已在等待中时先取消之前的那次
+    TimerHandle addTimer(TimerEntry& entry, std::chrono::nanoseconds timeout);
+    // 只取消句柄对应的那次添加, 语义同TimerEntry::cancel()
+    bool cancelTimer(const TimerHandle& handle);
 
-    // 拿到堆中最近的超时时间
+    // 拿到最近的超时时间, 毫秒向上取整 -> 按它等待不会早于超时时间醒来
+    // 拥有分片的线程只看自己的分片, 其他线程看所有分片
     uint64_t getNextTimer();
+    // 纳秒, 没有timer时返回~0ull
+    uint64_t getNextTimerNs();
 
-    // 取出所有超时定时器的回调函数
+    // 取出所有超时定时器的回调函数, 分片的范围同getNextTimer()
+    // 超时的TimerEntry在这里直接执行回调
     void listExpiredCb(std::vector<std::function<void()>>& cbs);
 
-    // 堆中是否有timer
+    // 所有分片中是否有timer
     bool hasTimer();
 
+    size_t getTimerShardCount() const { return m_shards.size(); }
+
+    // 允许timer晚于超时时间最多slack触发, 默认0
+    // 等待时按最早的timer加slack计算超时时间, 醒来时所有已超时的timer一起触发 -> 相近的超时时间合并为一次唤醒
+    void setTimerSlack(std::chrono::nanoseconds slack) { m_slack = slack.count(); }
+    std::chrono::nanoseconds getTimerSlack() const { return std::chrono::nanoseconds(m_slack.load()); }
+
 protected:
-    // 当一个最早的timer加入到堆中 -> 调用该函数 -> 调整epoll_wait超时时间
-    virtual void onTimerInsertedAtFront(){};
+    // 分片上加入了一个最早的timer, 且不是分片的所有者加入的 -> 调用该函数 -> 唤醒所有者调整epoll_wait超时时间
+    virtual void onTimerInsertedAtFront(int /*shard*/) {}
+
+    // 当前线程拥有的分片, -1 -> 不拥有分片
+    virtual int getTimerShard() { return -1; }
+    // 不拥有分片的线程添加timer时放到哪个分片, 默认轮流
+    virtual int pickTimerShard();
 
     // 添加timer
     void addTimer(std::shared_ptr<Timer> timer);
 
 private:
-    // 当系统时间改变时 -> 调用该函数
-    bool detectClockRollover();
+    struct Shard
+    {
+        std::mutex mutex;
+        // 时间堆
+        std::unique_ptr<TimerQueue> timers;
+
+        // 在下次getNextTime()执行前
+        // onTimerInsertedAtFront()是否已经被触发了
+        // -> 在此过程中 onTimerInsertedAtFront()只执行一次
+        bool tickled = false;
+
+        // 等待中的timer数, hasTimer()不加锁读取
+        std::atomic<size_t> count = {0};
+
+        // 其他线程取消的Timer, 无锁链表, 取出前Timer由m_self保持存活
+        std::atomic<Timer*> cancelled = {nullptr};
+
+        // 正在执行回调的TimerEntry和执行它的线程
+        std::vector<std::pair<TimerEntry*, std::thread::id>> running;
+    };
+
+    // check_generation为false时取消entry当前的那次添加
+    bool cancelEntry(TimerEntry* entry, uint64_t generation, bool check_generation);
+    // 插入队列, 需要持有分片的锁, remote为true表示不是分片的所有者插入的
+    // 返回是否需要调用onTimerInsertedAtFront()
+    bool insertLocked(Shard& shard, TimerNode* timer, bool remote);
+    // 删除被其他线程取消的Timer, 需要持有分片的锁
+    void drainCancelled(Shard& shard);
+    // 单个分片的getNextTimerNs()/listExpiredCb()
+    uint64_t getNextTimerNs(Shard& shard, Timer::TimePoint now);
+    void listExpiredCb(Shard& shard, Timer::TimePoint now, std::vector<std::function<void()>>& cbs);
 
 private:
-    std::shared_mutex m_mutex;
-    // 时间堆
-    std::set<std::shared_ptr<Timer>, Timer::Comparator> m_timers;
-    
-    // 在下次getNextTime()执行前 
-    // onTimerInsertedAtFront()是否已经被触发了 
-    // -> 在此过程中 onTimerInsertedAtFront()只执行一次
-    bool m_tickled = false;
-
-    // 上次检查系统时间是否回退的绝对时间
-    std::chrono::time_point<std::chrono::system_clock> m_previouseTime;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    // pickTimerShard()轮流的计数
+    std::atomic<size_t> m_nextShard = {0};
+    // 纳秒
+    std::atomic<int64_t> m_slack = {0};
 };
 
 
@@ -102,4 +276,4 @@ private:
 
 
 
-#endif
\ No newline at end of file
+#endif
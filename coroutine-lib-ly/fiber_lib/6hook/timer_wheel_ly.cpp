@@ -0,0 +1,245 @@
+#include "timer_wheel_ly.h"
+
+#include <limits>
+#include <algorithm>
+
+namespace sylar {
+
+// 循环右移, bit k对应原来的bit (k+shift)%64
+static inline uint64_t rotr64(uint64_t bits, unsigned shift)
+{
+    shift &= 63;
+    return shift ? (bits >> shift) | (bits << (64 - shift)) : bits;
+}
+
+TimerWheel::TimerWheel(TimerNode::TimePoint start):
+m_start(start), m_front(std::numeric_limits<int64_t>::max())
+{
+}
+
+uint64_t TimerWheel::toTick(TimerNode::TimePoint tp) const
+{
+    if(tp <= m_start)
+    {
+        return 0;
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(tp - m_start).count();
+}
+
+TimerNode::TimePoint TimerWheel::fromTick(uint64_t tick) const
+{
+    return m_start + std::chrono::milliseconds(tick);
+}
+
+void TimerWheel::link(TimerNode* timer)
+{
+    uint64_t tick = std::max(toTick(timer->m_next), m_now);
+    uint64_t delta = tick - m_now;
+
+    int level = 0;
+    while(level < LEVELS - 1 && delta >= (1ull << (SLOT_BITS * (level + 1))))
+    {
+        level++;
+    }
+    // 超出最高层范围 -> 放在最远的槽, 下放时再重新归档
+    if(delta >= (1ull << (SLOT_BITS * LEVELS)))
+    {
+        tick = m_now + (1ull << (SLOT_BITS * LEVELS)) - 1;
+    }
+
+    int slot = (tick >> (SLOT_BITS * level)) & (SLOTS - 1);
+    TimerNode*& head = m_slots[level][slot];
+    timer->m_wheelPrev = nullptr;
+    timer->m_wheelNext = head;
+    if(head)
+    {
+        head->m_wheelPrev = timer;
+    }
+    head = timer;
+    timer->m_queueIndex = level * SLOTS + slot;
+    m_bitmap[level] |= 1ull << slot;
+}
+
+void TimerWheel::unlink(TimerNode* timer)
+{
+    int level = timer->m_queueIndex / SLOTS;
+    int slot = timer->m_queueIndex % SLOTS;
+
+    if(timer->m_wheelPrev)
+    {
+        timer->m_wheelPrev->m_wheelNext = timer->m_wheelNext;
+    }
+    else
+    {
+        m_slots[level][slot] = timer->m_wheelNext;
+        if(!timer->m_wheelNext)
+        {
+            m_bitmap[level] &= ~(1ull << slot);
+        }
+    }
+    if(timer->m_wheelNext)
+    {
+        timer->m_wheelNext->m_wheelPrev = timer->m_wheelPrev;
+    }
+
+    timer->m_wheelPrev = nullptr;
+    timer->m_wheelNext = nullptr;
+    timer->m_queueIndex = -1;
+}
+
+void TimerWheel::cascade(int level)
+{
+    int slot = (m_now >> (SLOT_BITS * level)) & (SLOTS - 1);
+    TimerNode* timer = m_slots[level][slot];
+    m_slots[level][slot] = nullptr;
+    m_bitmap[level] &= ~(1ull << slot);
+
+    // 离超时已不足本层一个槽的跨度 -> 一定落到更低的层
+    while(timer)
+    {
+        TimerNode* next = timer->m_wheelNext;
+        link(timer);
+        timer = next;
+    }
+}
+
+void TimerWheel::expireSlot(TimerNode::TimePoint now, bool all, std::vector<TimerNode*>& expired)
+{
+    TimerNode* timer = m_slots[0][m_now & (SLOTS - 1)];
+    while(timer)
+    {
+        TimerNode* next = timer->m_wheelNext;
+        if(all || timer->m_next < now)
+        {
+            unlink(timer);
+            m_size--;
+            expired.push_back(timer);
+        }
+        timer = next;
+    }
+}
+
+bool TimerWheel::insert(TimerNode* timer)
+{
+    link(timer);
+    m_size++;
+
+    int64_t next = timer->m_next.time_since_epoch().count();
+    if(next < m_front)
+    {
+        m_front = next;
+        return true;
+    }
+    return false;
+}
+
+bool TimerWheel::erase(TimerNode* timer)
+{
+    if(timer->m_queueIndex < 0)
+    {
+        return false;
+    }
+    unlink(timer);
+    m_size--;
+    return true;
+}
+
+bool TimerWheel::front(TimerNode::TimePoint& next)
+{
+    if(m_size == 0)
+    {
+        m_front = std::numeric_limits<int64_t>::max();
+        return false;
+    }
+
+    auto best = TimerNode::TimePoint::max();
+
+    // 第0层: 从当前刻度起第一个非空槽, 槽内是同一刻度的timer, 取精确的最小值
+    if(m_bitmap[0])
+    {
+        unsigned pos = m_now & (SLOTS - 1);
+        unsigned k = __builtin_ctzll(rotr64(m_bitmap[0], pos));
+        for(TimerNode* timer = m_slots[0][(pos + k) & (SLOTS - 1)]; timer; timer = timer->m_wheelNext)
+        {
+            best = std::min(best, timer->m_next);
+        }
+    }
+
+    // 更高层: 第一个非空槽开始下放的时刻, 是槽内timer超时时间的下界
+    for(int level = 1; level < LEVELS; level++)
+    {
+        if(!m_bitmap[level])
+        {
+            continue;
+        }
+        uint64_t block = m_now >> (SLOT_BITS * level);
+        unsigned k = __builtin_ctzll(rotr64(m_bitmap[level], (block + 1) & (SLOTS - 1)));
+        best = std::min(best, fromTick((block + 1 + k) << (SLOT_BITS * level)));
+    }
+
+    m_front = best.time_since_epoch().count();
+    next = best;
+    return true;
+}
+
+void TimerWheel::popExpired(TimerNode::TimePoint now, std::vector<TimerNode*>& expired)
+{
+    uint64_t target = toTick(now);
+    while(m_now < target)
+    {
+        // 当前刻度已经整体过去
+        expireSlot(now, true, expired);
+        if(m_size == 0)
+        {
+            m_now = target;
+            break;
+        }
+
+        // 第0层为空 -> 直接跳到下一个可能需要下放的刻度
+        uint64_t next = m_now + 1;
+        if(!m_bitmap[0])
+        {
+            next = std::min(target, (m_now | (SLOTS - 1)) + 1);
+        }
+        m_now = next;
+
+        // 先下放高层, 下放下来的timer可能落在同时要下放的低层槽中
+        if((m_now & (SLOTS - 1)) == 0)
+        {
+            for(int level = LEVELS - 1; level > 0; level--)
+            {
+                if((m_now & ((1ull << (SLOT_BITS * level)) - 1)) == 0)
+                {
+                    cascade(level);
+                }
+            }
+        }
+    }
+    // 当前刻度只过去了一部分
+    expireSlot(now, false, expired);
+}
+
+void TimerWheel::popAll(std::vector<TimerNode*>& expired)
+{
+    for(int level = 0; level < LEVELS; level++)
+    {
+        for(int slot = 0; slot < SLOTS; slot++)
+        {
+            TimerNode* timer = m_slots[level][slot];
+            while(timer)
+            {
+                TimerNode* next = timer->m_wheelNext;
+                timer->m_wheelPrev = nullptr;
+                timer->m_wheelNext = nullptr;
+                timer->m_queueIndex = -1;
+                expired.push_back(timer);
+                timer = next;
+            }
+            m_slots[level][slot] = nullptr;
+        }
+        m_bitmap[level] = 0;
+    }
+    m_size = 0;
+}
+
+}
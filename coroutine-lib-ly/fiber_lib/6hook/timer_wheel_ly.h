@@ -0,0 +1,57 @@
+#ifndef _TIMER_WHEEL_LY_H_
+#define _TIMER_WHEEL_LY_H_
+
+#include "timer_ly.h"
+
+#include <cstdint>
+
+namespace sylar {
+
+// 分层时间轮
+// 刻度1ms, 每层64个槽, 第l层一个槽覆盖64^l个刻度, 共6层(约2.2年), 更远的timer放在最高层, 下放时重新归档
+// 槽位是TimerNode上的侵入式双向链表 -> 插入/删除O(1); 每层一个64位占用位图, 查找最近的非空槽只看位图
+// 第0层的槽对应单个刻度, 其余层的槽在本层当前槽位走到它时整体下放到更低的层
+class TimerWheel : public TimerQueue
+{
+public:
+    explicit TimerWheel(TimerNode::TimePoint start);
+
+    bool insert(TimerNode* timer) override;
+    bool erase(TimerNode* timer) override;
+    bool front(TimerNode::TimePoint& next) override;
+    void popExpired(TimerNode::TimePoint now, std::vector<TimerNode*>& expired) override;
+    void popAll(std::vector<TimerNode*>& expired) override;
+    bool empty() const override { return m_size == 0; }
+
+private:
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const int LEVELS = 6;
+
+    // 相对m_start的刻度, 早于m_start的算作0
+    uint64_t toTick(TimerNode::TimePoint tp) const;
+    TimerNode::TimePoint fromTick(uint64_t tick) const;
+
+    // 按超时时间相对m_now放入对应的槽
+    void link(TimerNode* timer);
+    void unlink(TimerNode* timer);
+    // 把第level层当前槽中的timer下放
+    void cascade(int level);
+    // 取出第0层当前刻度槽中在now之前超时的timer, all为true时取出整个槽
+    void expireSlot(TimerNode::TimePoint now, bool all, std::vector<TimerNode*>& expired);
+
+private:
+    TimerNode::TimePoint m_start;
+    // 当前刻度, 小于它的刻度都已处理
+    uint64_t m_now = 0;
+    size_t m_size = 0;
+    TimerNode* m_slots[LEVELS][SLOTS] = {};
+    uint64_t m_bitmap[LEVELS] = {};
+
+    // 最早超时时间的下界, 由front()更新, 用来判断新timer是否排在最前
+    int64_t m_front;
+};
+
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef _WORK_QUEUE_LY_H_
+#define _WORK_QUEUE_LY_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace sylar {
+
+// 工作线程的本地任务队列(Chase-Lev 无锁双端队列)
+// 只有所属线程可以push(从bottom端入队), 任意线程都可以steal(从top端出队, CAS竞争)
+// 所属线程自己也从top端取 -> 保持FIFO, 不断重新调度自身的协程不会饿死队列中的其他任务
+// 容量不足时扩容为两倍, 旧数组可能仍被其他线程读取, 留到析构时释放
+template <class T>
+class WorkStealingQueue
+{
+public:
+    explicit WorkStealingQueue(int64_t capacity = 256)
+    {
+        m_array.store(new Array(capacity), std::memory_order_relaxed);
+    }
+
+    ~WorkStealingQueue()
+    {
+        for(auto array : m_garbage)
+        {
+            delete array;
+        }
+        delete m_array.load(std::memory_order_relaxed);
+    }
+
+    WorkStealingQueue(const WorkStealingQueue&) = delete;
+    WorkStealingQueue& operator=(const WorkStealingQueue&) = delete;
+
+    // 只能由所属线程调用
+    void push(T* item)
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        Array* array = m_array.load(std::memory_order_relaxed);
+        if(b - t > array->capacity - 1)
+        {
+            Array* bigger = array->grow(b, t);
+            m_garbage.push_back(array);
+            array = bigger;
+            m_array.store(array, std::memory_order_release);
+        }
+        array->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // 任意线程调用, 取最早入队的元素, 为空返回nullptr
+    T* steal()
+    {
+        while(true)
+        {
+            int64_t t = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = m_bottom.load(std::memory_order_acquire);
+            if(t >= b)
+            {
+                return nullptr;
+            }
+
+            Array* array = m_array.load(std::memory_order_acquire);
+            T* item = array->get(t);
+            // CAS失败 -> 被其他线程取走, 重试
+            if(m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                return item;
+            }
+        }
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    // 并发时只是近似值
+    size_t size() const
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+private:
+    // 环形数组, 容量为2的幂
+    struct Array
+    {
+        int64_t capacity;
+        int64_t mask;
+        std::atomic<T*>* slots;
+
+        explicit Array(int64_t c) : capacity(c), mask(c - 1), slots(new std::atomic<T*>[c]) {}
+        ~Array() {delete[] slots;}
+
+        T* get(int64_t i) {return slots[i & mask].load(std::memory_order_relaxed);}
+        void put(int64_t i, T* item) {slots[i & mask].store(item, std::memory_order_relaxed);}
+
+        Array* grow(int64_t bottom, int64_t top)
+        {
+            Array* array = new Array(capacity * 2);
+            for(int64_t i = top; i < bottom; i++)
+            {
+                array->put(i, get(i));
+            }
+            return array;
+        }
+    };
+
+private:
+    // 分开缓存行, 避免steal的CAS与push互相干扰
+    alignas(64) std::atomic<int64_t> m_top{0};
+    alignas(64) std::atomic<int64_t> m_bottom{0};
+    std::atomic<Array*> m_array{nullptr};
+    // 扩容后的旧数组
+    std::vector<Array*> m_garbage;
+};
+
+}
+
+#endif